@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "common.h"
+
+// Allocation of large tables (hash table buckets, dynamic programming arrays).
+// On Linux, these are mapped directly so that they can be backed by huge pages
+// and placed according to a NUMA policy; elsewhere, calloc() is used.
+
+#ifndef _ALLOC_H
+#define _ALLOC_H 1
+
+/* huge page modes */
+#define HUGEPAGES_NONE 0
+#define HUGEPAGES_THP 1 // transparent huge pages, via madvise()
+#define HUGEPAGES_2M 2 // explicit (hugetlbfs) 2 MB pages
+#define HUGEPAGES_1G 3 // explicit (hugetlbfs) 1 GB pages
+
+/* NUMA policies, the same numbers as MPOL_* in <linux/mempolicy.h> */
+#define NUMA_NONE 0
+#define NUMA_LOCAL 4
+#define NUMA_INTERLEAVE 3
+
+int hugepages_mode = HUGEPAGES_THP;
+int numa_policy = NUMA_NONE;
+
+// statistics: current and peak bytes allocated with each huge page mode
+llu alloc_current[4], alloc_peak[4];
+
+// current large tables, with the lengths needed by munmap(); the array grows
+// as needed, as every solver has its own tables. It is kept apart from the
+// tables so that they stay aligned to their pages.
+struct large_mapping {
+    void *p;
+    size_t len;
+    size_t size;
+    int mode;
+};
+
+struct large_mapping *large_mappings = NULL;
+int large_mappings_count = 0, large_mappings_cap = 0;
+
+#ifdef __linux__
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#define HUGE_2M (1ULL << 21)
+#define HUGE_1G (1ULL << 30)
+
+// rounds size up to a multiple of the page size used by mode
+size_t large_alloc_round(size_t size, int mode)
+{
+    size_t page = (mode == HUGEPAGES_1G) ? HUGE_1G : (mode == HUGEPAGES_2M) ? HUGE_2M : (size_t) sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+// Returns the size of the explicit huge pages of mode, 0 for the other modes.
+size_t large_alloc_hugepage(int mode)
+{
+    return (mode == HUGEPAGES_1G) ? HUGE_1G : (mode == HUGEPAGES_2M) ? HUGE_2M : 0;
+}
+
+// Applies the NUMA policy to a mapping; interleaves over all nodes.
+void large_alloc_numa(void *p, size_t size)
+{
+#ifdef SYS_mbind
+    if(numa_policy == NUMA_NONE)
+    {
+	return;
+    }
+    unsigned long nodemask[16];
+    memset(nodemask, (numa_policy == NUMA_INTERLEAVE) ? 0xff : 0, sizeof(nodemask));
+    if(syscall(SYS_mbind, p, size, numa_policy, (numa_policy == NUMA_INTERLEAVE) ? nodemask : NULL,
+	       (numa_policy == NUMA_INTERLEAVE) ? 8*sizeof(nodemask) : 0, 0) != 0)
+    {
+	DEBUG_PRINT("mbind() failed, keeping the default NUMA policy.\n");
+    }
+#endif
+}
+#endif
+
+/* Returns the memory a table of size bytes takes: whole explicit huge pages
+ * if it is large enough to get them, see large_alloc(), otherwise its size.
+ */
+size_t large_alloc_footprint(size_t size)
+{
+#ifdef __linux__
+    size_t huge = large_alloc_hugepage(hugepages_mode);
+    if(huge > 0 && size >= huge)
+    {
+	return large_alloc_round(size, hugepages_mode);
+    }
+#endif
+    return size;
+}
+
+void large_mapping_add(void *p, size_t len, size_t size, int mode)
+{
+    int i = 0;
+    while(i < large_mappings_count && large_mappings[i].p != NULL)
+    {
+	i++;
+    }
+    if(i == large_mappings_count)
+    {
+	if(large_mappings_count == large_mappings_cap)
+	{
+	    large_mappings_cap = (large_mappings_cap == 0) ? 64 : 2*large_mappings_cap;
+	    large_mappings = realloc(large_mappings, large_mappings_cap*sizeof(struct large_mapping));
+	    assert(large_mappings != NULL);
+	}
+	large_mappings_count++;
+    }
+    large_mappings[i].p = p;
+    large_mappings[i].len = len;
+    large_mappings[i].size = size;
+    large_mappings[i].mode = mode;
+    alloc_current[mode] += size;
+    if(alloc_current[mode] > alloc_peak[mode])
+    {
+	alloc_peak[mode] = alloc_current[mode];
+    }
+}
+
+/* Allocates size bytes of zeroed memory for a large table. Tries explicit huge pages
+ * first if requested and the table fills at least one of them, falls back to
+ * transparent huge pages and to regular pages. Free with large_free().
+ */
+void* large_alloc(size_t size)
+{
+#ifdef __linux__
+    void *p = MAP_FAILED;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    // a smaller table would pin a whole huge page, which a larger one can use better
+    size_t huge = large_alloc_hugepage(hugepages_mode);
+    if(huge > 0 && size >= huge)
+    {
+	int pageflag = (hugepages_mode == HUGEPAGES_1G) ? (30 << MAP_HUGE_SHIFT) : (21 << MAP_HUGE_SHIFT);
+	p = mmap(NULL, large_alloc_round(size, hugepages_mode), PROT_READ | PROT_WRITE,
+		 flags | MAP_HUGETLB | pageflag, -1, 0);
+	if(p != MAP_FAILED)
+	{
+	    large_mapping_add(p, large_alloc_round(size, hugepages_mode), size, hugepages_mode);
+	    large_alloc_numa(p, large_alloc_round(size, hugepages_mode));
+	    return p;
+	}
+	DEBUG_PRINT("Explicit huge pages are not available, falling back.\n");
+    }
+
+    p = mmap(NULL, large_alloc_round(size, HUGEPAGES_NONE), PROT_READ | PROT_WRITE, flags, -1, 0);
+    assert(p != MAP_FAILED);
+    large_alloc_numa(p, large_alloc_round(size, HUGEPAGES_NONE));
+    int mode = HUGEPAGES_NONE;
+#ifdef MADV_HUGEPAGE
+    if(hugepages_mode != HUGEPAGES_NONE && size >= HUGE_2M
+       && madvise(p, large_alloc_round(size, HUGEPAGES_NONE), MADV_HUGEPAGE) == 0)
+    {
+	mode = HUGEPAGES_THP;
+    }
+#endif
+    large_mapping_add(p, large_alloc_round(size, HUGEPAGES_NONE), size, mode);
+    return p;
+#else
+    void *p = calloc(1, size);
+    assert(p != NULL);
+    large_mapping_add(p, size, size, HUGEPAGES_NONE);
+    return p;
+#endif
+}
+
+void large_free(void *p)
+{
+    if(p == NULL)
+    {
+	return;
+    }
+    for(int i=0; i<large_mappings_count; i++)
+    {
+	if(large_mappings[i].p == p)
+	{
+#ifdef __linux__
+	    munmap(p, large_mappings[i].len);
+#else
+	    free(p);
+#endif
+	    alloc_current[large_mappings[i].mode] -= large_mappings[i].size;
+	    large_mappings[i].p = NULL;
+	    return;
+	}
+    }
+    assert(false);
+}
+
+// Parses the argument of --hugepages; returns -1 if it is not valid.
+int parse_hugepages(const char *str)
+{
+    if(strcmp(str, "none") == 0) return HUGEPAGES_NONE;
+    if(strcmp(str, "thp") == 0) return HUGEPAGES_THP;
+    if(strcmp(str, "2M") == 0) return HUGEPAGES_2M;
+    if(strcmp(str, "1G") == 0) return HUGEPAGES_1G;
+    return -1;
+}
+
+// Parses the argument of --numa; returns -1 if it is not valid.
+int parse_numa(const char *str)
+{
+    if(strcmp(str, "none") == 0) return NUMA_NONE;
+    if(strcmp(str, "local") == 0) return NUMA_LOCAL;
+    if(strcmp(str, "interleave") == 0) return NUMA_INTERLEAVE;
+    return -1;
+}
+
+// Reports the peak size of the large tables with each kind of pages.
+void alloc_report()
+{
+    fprintf(stderr, "Large tables: %.1f MB in 1 GB pages, %.1f MB in 2 MB pages, %.1f MB advised as transparent huge pages, %.1f MB in regular pages.\n",
+	    (double) alloc_peak[HUGEPAGES_1G] / (1 << 20), (double) alloc_peak[HUGEPAGES_2M] / (1 << 20),
+	    (double) alloc_peak[HUGEPAGES_THP] / (1 << 20), (double) alloc_peak[HUGEPAGES_NONE] / (1 << 20));
+}
+
+#endif
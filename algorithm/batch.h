@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "hash.h"
+#include "measure.h"
+#include "solver.h"
+#include "minimax.h"
+#include "pn.h"
+#include "daemon.h"
+
+// Batch evaluation (--batch FILE): evaluates the configurations of FILE, or of
+// the standard input if FILE is "-", one per line in the syntax of the daemon:
+//
+//   L1 ... LBINS C1 ... CS [tree]
+//
+// Empty lines and lines starting with '#' are skipped. Each configuration is
+// answered by "N result V T" or "N error MESSAGE" on the standard output,
+// where N is its line number, followed by the game tree and "end" as in the
+// daemon. --jobs J evaluates J lines at a time by J threads, each with its own
+// solver whose caches stay warm over the lines it takes; the answers are still
+// written in the order of the lines, as soon as all earlier ones are.
+
+#ifndef _BATCH_H
+#define _BATCH_H 1
+
+typedef struct batch_state {
+    FILE *in;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    // lines read and lines whose answer is written
+    llu read, written;
+} batch_state;
+
+typedef struct batch_job {
+    solver s;
+    batch_state *st;
+} batch_job;
+
+// Answers one input line into a buffer; returns its length, 0 for no answer.
+size_t batch_answer(solver *s, const char *line, llu n, char **buf)
+{
+    const char *p = line;
+    while(*p == ' ' || *p == '\t')
+	p++;
+    if(*p == '\0' || *p == '\n' || *p == '#')
+    {
+	*buf = NULL;
+	return 0;
+    }
+
+    size_t len;
+    FILE *out = open_memstream(buf, &len);
+    assert(out != NULL);
+    fprintf(out, "%llu ", n);
+
+    binconf b;
+    char err[256];
+    const char *rest = binconf_parse(s, p, &b, err, sizeof(err));
+    if(rest == NULL)
+    {
+	fprintf(out, "error %s\n", err);
+    } else {
+	evaluate_report(s, out, &b, tree_requested(rest));
+    }
+    fclose(out);
+    return len;
+}
+
+void *batch_thread(void *arg)
+{
+    batch_job *job = (batch_job *) arg;
+    batch_state *st = job->st;
+    char line[DAEMON_LINE];
+    while(true)
+    {
+	pthread_mutex_lock(&st->lock);
+	bool eof = (fgets(line, sizeof(line), st->in) == NULL);
+	llu n = eof ? 0 : ++st->read;
+	pthread_mutex_unlock(&st->lock);
+	if(eof)
+	    break;
+
+	char *buf;
+	size_t len = batch_answer(&job->s, line, n, &buf);
+
+	// the answers leave in the order of the lines
+	pthread_mutex_lock(&st->lock);
+	while(st->written != n-1)
+	    pthread_cond_wait(&st->turn, &st->lock);
+	if(len > 0)
+	{
+	    fwrite(buf, 1, len, stdout);
+	    fflush(stdout);
+	}
+	st->written = n;
+	pthread_cond_broadcast(&st->turn);
+	pthread_mutex_unlock(&st->lock);
+	free(buf);
+    }
+    return NULL;
+}
+
+/* Evaluates the configurations in file by jobs threads. The first one uses
+ * solver s, the others get solvers with tables of the same sizes, so a memory
+ * budget has to be divided by jobs beforehand. The counters of all solvers
+ * are added to s. Returns the number of lines read, or -1 if file cannot be
+ * opened.
+ */
+long long batch_main(solver *s, const char *file, int jobs)
+{
+    batch_state st = {.read = 0, .written = 0};
+    st.in = (strcmp(file, "-") == 0) ? stdin : fopen(file, "r");
+    if(st.in == NULL)
+    {
+	fprintf(stderr, "Batch: unable to open %s.\n", file);
+	return -1;
+    }
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.turn, NULL);
+
+    batch_job *job = malloc(jobs * sizeof(batch_job));
+    pthread_t *thread = malloc(jobs * sizeof(pthread_t));
+    assert(job != NULL && thread != NULL);
+    job[0].s = *s;
+    for(int j=0; j<jobs; j++)
+    {
+	job[j].st = &st;
+	if(j > 0)
+	{
+	    solver_init(&job[j].s);
+	    job[j].s.ht.size = s->ht.size; job[j].s.ht.chainlen = s->ht.chainlen;
+	    job[j].s.domht.size = s->domht.size; job[j].s.domht.chainlen = s->domht.chainlen;
+	    job[j].s.dpht.size = s->dpht.size; job[j].s.dpht.chainlen = s->dpht.chainlen;
+	    job[j].s.pnsize = s->pnsize;
+	    solver_alloc(&job[j].s);
+	    if(engine == ENGINE_PN)
+	    {
+		pn_init(&job[j].s);
+	    }
+	}
+    }
+
+    for(int j=0; j<jobs; j++)
+    {
+	pthread_create(&thread[j], NULL, batch_thread, &job[j]);
+    }
+    for(int j=0; j<jobs; j++)
+    {
+	pthread_join(thread[j], NULL);
+    }
+
+    *s = job[0].s;
+    for(int j=1; j<jobs; j++)
+    {
+	measure_add(&s->measure, &job[j].s.measure);
+	solver_free(&job[j].s);
+	pn_cleanup(&job[j].s);
+    }
+    free(job);
+    free(thread);
+    pthread_cond_destroy(&st.turn);
+    pthread_mutex_destroy(&st.lock);
+    if(st.in != stdin)
+    {
+	fclose(st.in);
+    }
+    return (long long) st.read;
+}
+
+#endif
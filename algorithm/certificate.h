@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "hash.h"
+#include "solver.h"
+
+// Output of the lower bound as a compact binary certificate.
+// The format is shared with the verifier and described in data/README.
+
+#ifndef _CERTIFICATE_H
+#define _CERTIFICATE_H 1
+
+#define CERT_MAGIC "BSLB"
+#define CERT_VERSION 1
+
+/* declarations */
+void expand_cached(solver *s, gametree **vertex);
+
+// A vertex of the certificate; children are given by the bin (0-based, in the
+// decreasing order of loads) receiving the next item and by their dense ids.
+struct cert_vertex {
+    int item;
+    int count;
+    int bin[BINS];
+    int child[BINS];
+};
+
+typedef struct cert_vertex cert_vertex;
+
+cert_vertex *cert = NULL;
+int cert_len = 0, cert_cap = 0;
+
+/* Assigns dense ids to the vertices of the game tree in preorder.
+ * Configurations already present get an edge to their existing vertex,
+ * cached vertices are expanded by expand_cached() as in print_gametree().
+ * Returns the id of the tree.
+ */
+int cert_collect(solver *s, gametree *tree)
+{
+    assert(tree != NULL && tree->leaf != 1);
+
+    if(cert_len == cert_cap)
+    {
+	cert_cap = (cert_cap == 0) ? 1024 : 2*cert_cap;
+	cert = realloc(cert, cert_cap*sizeof(cert_vertex));
+	assert(cert != NULL);
+    }
+    int id = cert_len++;
+    cert[id].item = tree->nextItem;
+    cert[id].count = 0;
+    // the output table maps configurations to their ids
+    conf_map_put(&s->outht, tree->bc, id);
+
+    for(int i=1; i<=BINS; i++)
+    {
+	// leaves carry the configuration of their parent, skip them first
+	if(tree->next[i] == NULL || tree->next[i]->leaf == 1)
+	    continue;
+
+	int child = conf_map_get(&s->outht, tree->next[i]->bc);
+	if(child == -1)
+	{
+	    if(tree->next[i]->cached == 1)
+	    {
+		expand_cached(s, &(tree->next[i]));
+	    }
+	    if(tree->next[i]->leaf == 1)
+		continue;
+	    child = cert_collect(s, tree->next[i]);
+	}
+
+	cert[id].bin[cert[id].count] = i-1;
+	cert[id].child[cert[id].count] = child;
+	cert[id].count++;
+    }
+    return id;
+}
+
+void cert_put_varint(FILE *f, llu x)
+{
+    while(x >= 0x80)
+    {
+	fputc((int) (x & 0x7f) | 0x80, f);
+	x >>= 7;
+    }
+    fputc((int) x, f);
+}
+
+void cert_put_u16(FILE *f, int x)
+{
+    fputc(x & 0xff, f);
+    fputc((x >> 8) & 0xff, f);
+}
+
+/* Writes the game tree as a binary certificate.
+ * Returns false if the file cannot be written.
+ */
+bool cert_write(solver *s, const char *filename, gametree *tree)
+{
+    FILE *f = fopen(filename, "wb");
+    if(f == NULL)
+    {
+	fprintf(stderr, "Cannot open %s for writing.\n", filename);
+	return false;
+    }
+
+    // ids are stored in the output table, start from an empty one
+    conf_map_clear(&s->outht);
+    cert_len = 0;
+    binconf root;
+    duplicate(&root, tree->bc);
+    cert_collect(s, tree);
+
+    fputs(CERT_MAGIC, f);
+    fputc(CERT_VERSION, f);
+    fputc(BINS, f);
+    cert_put_u16(f, R);
+    cert_put_u16(f, S);
+    cert_put_varint(f, cert_len);
+    for(int i=1; i<=BINS; i++)
+    {
+	fputc(root.loads[i], f);
+    }
+    for(int j=1; j<=S; j++)
+    {
+	cert_put_varint(f, root.items[j]);
+    }
+
+    for(int id=0; id<cert_len; id++)
+    {
+	fputc(cert[id].item, f);
+	fputc(cert[id].count, f);
+	for(int c=0; c<cert[id].count; c++)
+	{
+	    // child offsets are zigzag-encoded, as children merged into a DAG may precede their parent
+	    long long offset = (long long) cert[id].child[c] - id;
+	    fputc(cert[id].bin[c], f);
+	    cert_put_varint(f, (offset >= 0) ? (llu) offset << 1 : ((llu) (-offset) << 1) - 1);
+	}
+    }
+
+    bool ok = (ferror(f) == 0);
+    ok &= (fclose(f) == 0);
+    fprintf(stderr, "Wrote a certificate with %d vertices to %s.\n", cert_len, filename);
+    free(cert);
+    cert = NULL;
+    cert_cap = 0;
+    return ok;
+}
+
+#endif
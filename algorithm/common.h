@@ -28,13 +28,25 @@ typedef signed char tiny;
 // Change this number for the selected number of bins.
 #define BINS 3
 
-// bitwise length of indices of the hash table
+// bitwise length of indices of the hash table, unless set by --memory
 #define HASHLOG 24
-// size of the hash table
-#define HASHSIZE (1<<HASHLOG)
+// default size of the hash table
+#define HASHSIZE (1ULL<<HASHLOG)
+// limits on the bitwise length of indices when sizing by --memory
+#define HASHLOG_MIN 10
+#define HASHLOG_MAX 30
 // maximum length of a chain on the same hash position
 #define CHAINLEN 4
 
+// Adversary heuristic: before the full search, try to refute a configuration
+// by sending the k largest items the optimum can accept, for k up to ADV_HEURISTIC_K.
+// Comment out to disable.
+#define ADV_HEURISTIC 1
+#define ADV_HEURISTIC_K (BINS+1)
+// bitwise length of the cache of k-move results
+#define KMOVE_CACHELOG 16
+#define KMOVE_CACHESIZE (1<<KMOVE_CACHELOG)
+
 // The following selects binarray size based on BINS. It does not need to be edited.
 #if BINS == 3
 #define BINARRAY_SIZE (S+1)*(S+1)*(S+1)
@@ -46,22 +58,51 @@ typedef signed char tiny;
 #define BINARRAY_SIZE (S+1)*(S+1)*(S+1)*(S+1)*(S+1)
 #endif
 
-// end of configuration constants; start of code
+// Dominance index: settle configurations from stored results with the same
+// loads and items differing by a merge of two items. Comment out to disable.
+#define DOMINANCE 1
+
+// Minimization of the lower bound before output (--minimize): passes over
+// the vertices of the DAG, each trying up to MINIMIZE_TRIES other winning
+// items, until a pass does not help or MINIMIZE_BUDGET vertices were tried.
+#define MINIMIZE_BUDGET 100000
+#define MINIMIZE_TRIES 4
+
+// Proof-number search (--engine pn): the proof and disproof numbers of the
+// vertices being searched are kept in a direct-mapped table of 2^PN_HASHLOG entries,
+// unless sized by --memory.
+#define PN_HASHLOG 22
+#define PN_HASHSIZE (1ULL<<PN_HASHLOG)
+
+// Retrograde analysis (--engine retro): gives up when the configurations
+// need more than RETRO_MEMORY MB; compares every RETRO_CROSSCHECK-th
+// configuration of each layer with the minimax. Uncomment to enable.
+#define RETRO_MEMORY 2048
+// #define RETRO_CROSSCHECK 100
+
+// Threshold search (--threshold): the bounds of the thresholds of the
+// configurations are kept in a direct-mapped table of 2^TH_HASHLOG entries,
+// unless sized by --memory.
+#define TH_HASHLOG 24
+#define TH_HASHSIZE (1ULL<<TH_HASHLOG)
 
-// a global variable for indexing the game tree vertices
-llu Treeid=1;
+// end of configuration constants; start of code
 
 // A bin configuration consisting of three loads and a list of items that have arrived so far.
 // The same DS is also used in the hash as an element.
 struct binconf {
     char loads[BINS+1];
     char items[S+1];
+    // in the position cache: the item refuting an adversary win, 0 if unknown;
+    // it fills the alignment padding before next
+    char refuting;
     // hash related properties
     struct binconf *next;
     llu loadhash;
     llu itemhash;
     unsigned int accesses;
     int posvalue;
+    unsigned int generation; // generation of the hash table when stored
 };
 
 typedef struct binconf binconf;
@@ -108,6 +149,8 @@ void duplicate(binconf *t, const binconf *s) {
     t->itemhash = s->itemhash;
     t->accesses = s->accesses;
     t->posvalue = s->posvalue;
+    t->generation = s->generation;
+    t->refuting = s->refuting;
 }
 
 void init(binconf *b)
@@ -117,6 +160,8 @@ void init(binconf *b)
     b->itemhash = 0;
     b->loadhash = 0;
     b->posvalue = -1;
+    b->generation = 0;
+    b->refuting = 0;
     for (int i=0; i<=BINS; i++)
     {
 	b->loads[i] = 0; 
@@ -191,27 +236,6 @@ void sortloads(binconf *b)
     assert(b->loads[2] >= b->loads[3]);
 }
 
-/* Initialize the game tree with the information in the parameters. */
-
-void init_gametree_vertex(gametree *tree, const binconf *b, int nextItem, int depth)
-{
-    tree->bc = malloc(sizeof(binconf));
-    init(tree->bc);
-    
-    tree->cached=0; tree->leaf=0;
-    tree->id = ++Treeid;
-    // tree->cached_conf = NULL;
-    tree->depth = depth;
-
-    duplicate(tree->bc, b);
-    
-    for(int i=1; i <= BINS; i++)
-    {
-	tree->next[i] = NULL;
-    }
-    tree->nextItem = nextItem;
-}
-
 /* Removes the game tree data. Call after all hash tables are deleted. */
 void delete_gametree(gametree *tree)
 {
@@ -245,6 +269,13 @@ void delete_gametree(gametree *tree)
 #define MIN(x,y,z) (y < x ? (z < y ? z : y) : (x < z ? x : z))
 */
 
+/* prefetching of hash table buckets */
+#ifdef __GNUC__
+#define PREFETCH(x) __builtin_prefetch(x)
+#else
+#define PREFETCH(x)
+#endif
+
 /* helper macros for debug, verbose, and measure output */
 
 #ifdef DEBUG
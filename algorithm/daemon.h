@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "common.h"
+#include "hash.h"
+#include "dynprog.h"
+#include "measure.h"
+#include "solver.h"
+#include "distributed.h"
+#include "pn.h"
+#include "retro.h"
+
+// Solver daemon (--daemon ADDRESS): one solver stays resident, with the
+// Zobrist tables, the dynamic programming cache and the position cache warm
+// from one request to the next. Clients connect to ADDRESS (as for the
+// distributed search) one at a time and send requests of one line each:
+//
+//   evaluate R S L1 ... LBINS C1 ... CS [tree]
+//       evaluates the configuration with loads L1, ..., LBINS and Cj items of
+//       size j; answers "result V T", where V is 0 if the adversary wins and 1
+//       if the algorithm does and T the time in seconds. With "tree", a win of
+//       the adversary is followed by its game tree in DOT and a line "end".
+//   stats
+//       answers lines "name value" on the caches and the counters, then "end".
+//   quit
+//       closes the connection.
+//   shutdown
+//       closes the connection and stops the daemon.
+//
+// R and S have to be the ones the daemon is compiled with. Bad requests are
+// answered by a line starting with "error".
+
+#ifndef _DAEMON_H
+#define _DAEMON_H 1
+
+// longest request line accepted
+#define DAEMON_LINE 4096
+
+/* declarations */
+int evaluate(solver *s, binconf *b, gametree **rettree, int depth);
+void print_gametree(solver *s, FILE *out, gametree *tree);
+
+/* Reads a configuration given as BINS loads followed by S item counts from
+ * str into b, which is hashed. Returns a pointer past the numbers read, or
+ * NULL with a message in err if the configuration is not valid: a load is
+ * R or more, the items do not sum up to the loads, or the offline optimum
+ * cannot pack them.
+ */
+const char* binconf_parse(solver *s, const char *str, binconf *b, char *err, size_t errlen)
+{
+    char *end;
+    int volume = 0;
+    init(b);
+    for(int i=1; i<=BINS + S; i++)
+    {
+	long x = strtol(str, &end, 10);
+	if(end == str)
+	{
+	    snprintf(err, errlen, "expected %d loads and %d item counts", BINS, S);
+	    return NULL;
+	}
+	str = end;
+	if(i <= BINS)
+	{
+	    if(x < 0 || x >= R)
+	    {
+		snprintf(err, errlen, "load %ld is not between 0 and %d", x, R-1);
+		return NULL;
+	    }
+	    b->loads[i] = (char) x;
+	    volume += x;
+	} else {
+	    if(x < 0 || x > BINS*S)
+	    {
+		snprintf(err, errlen, "item count %ld is not between 0 and %d", x, BINS*S);
+		return NULL;
+	    }
+	    b->items[i-BINS] = (char) x;
+	    volume -= x*(i-BINS);
+	}
+    }
+    if(volume != 0)
+    {
+	snprintf(err, errlen, "the items do not sum up to the loads");
+	return NULL;
+    }
+    sortloads(b);
+    hashinit(b);
+    if(totalload(b) > 0 && !TEST(s, b))
+    {
+	snprintf(err, errlen, "the offline optimum cannot pack the items");
+	return NULL;
+    }
+    return str;
+}
+
+/* Evaluates the configuration b and writes "result V T" to out, followed by
+ * the game tree in DOT and a line "end" if tree is set and the adversary wins.
+ */
+void evaluate_report(solver *s, FILE *out, binconf *b, bool tree)
+{
+    struct timeval start, stop, diff;
+    gametree *t = NULL;
+    gettimeofday(&start, NULL);
+    // the proof-number and the retrograde engines keep no results between searches
+    if(engine == ENGINE_PN)
+    {
+	pn_reset(s);
+    } else if(engine == ENGINE_RETRO)
+    {
+	retro_free();
+    }
+    int ret = evaluate(s, b, &t, 0);
+    gettimeofday(&stop, NULL);
+    timeval_subtract(&diff, &stop, &start);
+    fprintf(out, "result %d %ld.%06ld\n", ret, (long) diff.tv_sec, (long) diff.tv_usec);
+
+    if(ret == 0)
+    {
+	if(tree)
+	{
+	    conf_map_clear(&s->outht);
+	    fprintf(out, "strict digraph %d%d {\n", R, S);
+	    fprintf(out, "overlap = none;\n");
+	    print_gametree(s, out, t);
+	    fprintf(out, "}\nend\n");
+	}
+	delete_gametree(t);
+    }
+}
+
+// true if the rest of a request line asks for the game tree
+bool tree_requested(const char *rest)
+{
+    while(*rest == ' ' || *rest == '\t')
+	rest++;
+    return strncmp(rest, "tree", 4) == 0;
+}
+
+// Answers an evaluate request; args follows the word "evaluate".
+void daemon_evaluate(solver *s, FILE *out, const char *args)
+{
+    char *end, err[256];
+    long r = strtol(args, &end, 10);
+    long sz = strtol(end, &end, 10);
+    if(r != R || sz != S)
+    {
+	fprintf(out, "error the daemon is compiled for %d/%d on %d bins\n", R, S, BINS);
+	return;
+    }
+
+    binconf b;
+    const char *rest = binconf_parse(s, end, &b, err, sizeof(err));
+    if(rest == NULL)
+    {
+	fprintf(out, "error %s\n", err);
+	return;
+    }
+    evaluate_report(s, out, &b, tree_requested(rest));
+}
+
+void daemon_stats_table(FILE *out, const char *name, const conf_hashtable *table)
+{
+    fprintf(out, "%s_buckets %llu\n%s_entries %llu\n%s_peak %llu\n%s_reused %llu\n",
+	    name, table->size, name, table->entries, name, table->peak, name, table->reused);
+}
+
+// Answers a stats request; the counters of measure.h are 0 unless MEASURE is defined.
+void daemon_stats(solver *s, FILE *out, llu requests)
+{
+    fprintf(out, "requests %llu\n", requests);
+    daemon_stats_table(out, "ht", &s->ht);
+#ifdef DOMINANCE
+    daemon_stats_table(out, "domht", &s->domht);
+#endif
+    fprintf(out, "dpht_buckets %llu\ndpht_entries %llu\ndpht_peak %llu\n",
+	    s->dpht.size, s->dpht.entries, s->dpht.peak);
+    fprintf(out, "dp_calls %llu\nmaximum_feasible_calls %llu\n",
+	    s->measure.test_counter, s->measure.maximum_feasible_counter);
+    fprintf(out, "adv_heuristic_calls %llu\nadv_heuristic_hits %llu\nkmove_cache_hits %llu\n",
+	    s->measure.adv_heuristic_calls, s->measure.adv_heuristic_hits, s->measure.kmove_cache_hits);
+    fprintf(out, "dom_lookups %llu\ndom_hits_algorithm %llu\ndom_hits_adversary %llu\n",
+	    s->measure.dom_lookups, s->measure.dom_hits_algorithm, s->measure.dom_hits_adversary);
+    fprintf(out, "end\n");
+}
+
+/* Serves requests on address addr until a shutdown request.
+ * Returns 0, or -1 if the address cannot be listened on.
+ */
+int daemon_main(solver *s, const char *addr)
+{
+    int lfd = net_open(addr, true);
+    if(lfd < 0)
+    {
+	fprintf(stderr, "Daemon: unable to listen on %s.\n", addr);
+	return -1;
+    }
+    // a client leaving early must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Daemon: listening on %s for %d/%d on %d bins.\n", addr, R, S, BINS);
+
+    llu requests = 0;
+    bool shutdown = false;
+    char line[DAEMON_LINE];
+    while(!shutdown)
+    {
+	int fd = accept(lfd, NULL, NULL);
+	if(fd < 0)
+	    continue;
+	FILE *in = fdopen(fd, "r");
+	FILE *out = fdopen(dup(fd), "w");
+	if(in == NULL || out == NULL)
+	{
+	    if(in != NULL)
+		fclose(in);
+	    else
+		close(fd);
+	    if(out != NULL)
+		fclose(out);
+	    continue;
+	}
+
+	while(fgets(line, sizeof(line), in) != NULL)
+	{
+	    requests++;
+	    if(strncmp(line, "evaluate ", 9) == 0)
+	    {
+		daemon_evaluate(s, out, line + 9);
+	    } else if(strncmp(line, "stats", 5) == 0)
+	    {
+		daemon_stats(s, out, requests);
+	    } else if(strncmp(line, "quit", 4) == 0)
+	    {
+		break;
+	    } else if(strncmp(line, "shutdown", 8) == 0)
+	    {
+		shutdown = true;
+		break;
+	    } else {
+		fprintf(out, "error unknown request\n");
+	    }
+	    if(fflush(out) != 0)
+		break;
+	}
+	fclose(out);
+	fclose(in);
+    }
+
+    close(lfd);
+    if(strncmp(addr, "unix:", 5) == 0)
+    {
+	unlink(addr+5);
+    }
+    fprintf(stderr, "Daemon: %llu requests served.\n", requests);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,597 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "hash.h"
+#include "fits.h"
+#include "dynprog.h"
+#include "gs.h"
+#include "minimax.h"
+
+// Distributed search: a coordinator expands the game tree down to a split
+// depth and hands out the adversary vertices at that depth to worker
+// processes, which evaluate them and send back the results. Workers
+// connect over a Unix socket ("unix:/path") or TCP ("tcp:host:port").
+
+#ifndef _DISTRIBUTED_H
+#define _DISTRIBUTED_H 1
+
+// maximum number of connected workers
+#define MAX_WORKERS 256
+
+/* declarations */
+int evaluate(solver *s, binconf *b, gametree **rettree, int depth);
+
+/* message types */
+#define MSG_HELLO 1
+#define MSG_TASK 2
+#define MSG_RESULT 3
+#define MSG_CANCEL 4
+#define MSG_QUIT 5
+
+// All messages have the same fixed size; both sides are compiled with the same BINS, R and S,
+// which is checked by the initial MSG_HELLO exchange.
+struct net_msg {
+    int type;
+    int id;
+    int depth;
+    int value;
+    char loads[BINS+1];
+    char items[S+1];
+};
+
+typedef struct net_msg net_msg;
+
+/* A vertex of the top part of the game tree expanded by the coordinator. */
+struct dnode {
+    binconf bc;
+    int item; // item being packed (algorithm vertices only)
+    bool adv; // adversary vertex (true) or algorithm vertex (false)
+    bool task; // evaluated by a worker
+    int depth;
+    int parent;
+    int value; // -1 if unknown
+    int pending; // number of children with unknown value
+};
+
+typedef struct dnode dnode;
+
+dnode *dtree = NULL;
+int dtree_len = 0, dtree_cap = 0;
+int *dqueue = NULL; // tasks in the order of sending
+int dqueue_len = 0, dqueue_pos = 0;
+int dsplit = 1;
+
+/* socket helpers */
+
+// Opens a listening (listening == true) or a connected socket for the address.
+// Returns -1 on failure.
+int net_open(const char *addr, bool listening)
+{
+    int fd;
+    if(strncmp(addr, "unix:", 5) == 0)
+    {
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	if(strlen(addr+5) >= sizeof(sa.sun_path))
+	{
+	    return -1;
+	}
+	strcpy(sa.sun_path, addr+5);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0)
+	{
+	    return -1;
+	}
+	if(listening)
+	{
+	    unlink(sa.sun_path);
+	    if(bind(fd, (struct sockaddr *) &sa, sizeof(sa)) != 0 || listen(fd, MAX_WORKERS) != 0)
+	    {
+		close(fd);
+		return -1;
+	    }
+	} else if(connect(fd, (struct sockaddr *) &sa, sizeof(sa)) != 0)
+	{
+	    close(fd);
+	    return -1;
+	}
+	return fd;
+    } else if(strncmp(addr, "tcp:", 4) == 0)
+    {
+	char host[256];
+	const char *port = strrchr(addr+4, ':');
+	if(port == NULL || (size_t) (port - (addr+4)) >= sizeof(host))
+	{
+	    return -1;
+	}
+	memcpy(host, addr+4, port - (addr+4));
+	host[port - (addr+4)] = '\0';
+	port++;
+
+	struct addrinfo hints, *res, *p;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listening ? AI_PASSIVE : 0;
+	if(getaddrinfo(host[0] == '\0' ? NULL : host, port, &hints, &res) != 0)
+	{
+	    return -1;
+	}
+	fd = -1;
+	for(p = res; p != NULL; p = p->ai_next)
+	{
+	    fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+	    if(fd < 0)
+		continue;
+	    if(listening)
+	    {
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if(bind(fd, p->ai_addr, p->ai_addrlen) == 0 && listen(fd, MAX_WORKERS) == 0)
+		    break;
+	    } else if(connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+	    {
+		break;
+	    }
+	    close(fd);
+	    fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+    }
+    return -1;
+}
+
+// Sends or receives a whole message. Returns false if the connection is broken.
+bool net_send(int fd, const net_msg *m)
+{
+    const char *p = (const char *) m;
+    size_t left = sizeof(net_msg);
+    while(left > 0)
+    {
+	ssize_t w = write(fd, p, left);
+	if(w < 0 && errno == EINTR)
+	    continue;
+	if(w <= 0)
+	    return false;
+	p += w; left -= w;
+    }
+    return true;
+}
+
+bool net_recv(int fd, net_msg *m)
+{
+    char *p = (char *) m;
+    size_t left = sizeof(net_msg);
+    while(left > 0)
+    {
+	ssize_t r = read(fd, p, left);
+	if(r < 0 && errno == EINTR)
+	    continue;
+	if(r <= 0)
+	    return false;
+	p += r; left -= r;
+    }
+    return true;
+}
+
+void net_hello(net_msg *m)
+{
+    memset(m, 0, sizeof(net_msg));
+    m->type = MSG_HELLO;
+    m->id = BINS; m->depth = R; m->value = S;
+}
+
+/* worker */
+
+int worker_fd = -1;
+int worker_task = -1;
+bool worker_quit = false;
+
+// Called periodically from adversary(); aborts the search if the current task is cancelled.
+void worker_abort_check(solver *s)
+{
+    struct pollfd pfd;
+    net_msg m;
+    pfd.fd = worker_fd;
+    pfd.events = POLLIN;
+    while(poll(&pfd, 1, 0) > 0)
+    {
+	if(!net_recv(worker_fd, &m) || m.type == MSG_QUIT)
+	{
+	    worker_quit = true;
+	    s->search_aborted = true;
+	    return;
+	}
+	if(m.type == MSG_CANCEL && m.id == worker_task)
+	{
+	    DEBUG_PRINT("Worker %d: task %d cancelled.\n", (int) getpid(), m.id);
+	    s->search_aborted = true;
+	}
+    }
+}
+
+// Connects to the coordinator and evaluates tasks until told to quit.
+int worker_main(solver *s, const char *addr)
+{
+    net_msg m;
+    binconf b;
+    gametree *t;
+
+    for(int attempt = 0; (worker_fd = net_open(addr, false)) < 0; attempt++)
+    {
+	if(attempt >= 30)
+	{
+	    fprintf(stderr, "Worker: unable to connect to %s.\n", addr);
+	    return -1;
+	}
+	sleep(1);
+    }
+
+    net_hello(&m);
+    if(!net_send(worker_fd, &m))
+    {
+	return -1;
+    }
+
+    s->abort_check = worker_abort_check;
+    while(!worker_quit && net_recv(worker_fd, &m))
+    {
+	if(m.type == MSG_QUIT)
+	    break;
+	if(m.type != MSG_TASK)
+	    continue; // a late cancellation of a finished task
+
+	init(&b);
+	for(int i=1; i<=BINS; i++)
+	    b.loads[i] = m.loads[i];
+	for(int j=1; j<=S; j++)
+	    b.items[j] = m.items[j];
+
+	worker_task = m.id;
+	s->search_aborted = false;
+	int ret = evaluate(s, &b, &t, m.depth);
+	if(ret == 0)
+	{
+	    delete_gametree(t);
+	}
+
+	m.type = MSG_RESULT;
+	m.value = s->search_aborted ? -1 : ret;
+	worker_task = -1;
+	if(worker_quit || !net_send(worker_fd, &m))
+	    break;
+    }
+
+    s->abort_check = NULL;
+    close(worker_fd);
+    return 0;
+}
+
+/* coordinator */
+
+int dnode_new(const binconf *b, bool adv, int item, int depth, int parent)
+{
+    if(dtree_len == dtree_cap)
+    {
+	dtree_cap = (dtree_cap == 0) ? 1024 : 2*dtree_cap;
+	dtree = realloc(dtree, dtree_cap*sizeof(dnode));
+	assert(dtree != NULL);
+    }
+    dnode *n = &dtree[dtree_len];
+    duplicate(&n->bc, b);
+    n->adv = adv; n->task = false;
+    n->item = item; n->depth = depth;
+    n->parent = parent;
+    n->value = -1; n->pending = 0;
+    return dtree_len++;
+}
+
+int dexpand_algorithm(solver *s, const binconf *b, int item, int depth, int parent);
+
+// Expands an adversary vertex with configuration b.
+int dexpand_adversary(solver *s, const binconf *b, int depth, int parent)
+{
+    int id = dnode_new(b, true, 0, depth, parent);
+    int res[BINS+ADV_HEURISTIC_K];
+
+    if ((b->loads[BINS] + (BINS*S - totalload(b))) < R)
+    {
+	dtree[id].value = 1;
+	return id;
+    }
+#ifdef ADV_HEURISTIC
+    if(adversary_heuristic(s, b, res) > 0)
+    {
+	dtree[id].value = 0;
+	return id;
+    }
+#endif
+    if(depth >= dsplit)
+    {
+	dtree[id].task = true;
+	if(dqueue_len % 1024 == 0)
+	{
+	    dqueue = realloc(dqueue, (dqueue_len+1024)*sizeof(int));
+	    assert(dqueue != NULL);
+	}
+	dqueue[dqueue_len++] = id;
+	return id;
+    }
+
+    MAXIMUM_FEASIBLE(s, b, res);
+    for(int item_size = res[0]; item_size > 0; item_size--)
+    {
+	int child = dexpand_algorithm(s, b, item_size, depth, id);
+	if(dtree[child].value == 0)
+	{
+	    dtree[id].value = 0;
+	    return id;
+	}
+	if(dtree[child].value == -1)
+	    dtree[id].pending++;
+    }
+    if(dtree[id].pending == 0)
+    {
+	dtree[id].value = 1;
+    }
+    return id;
+}
+
+// Expands an algorithm vertex: item is being packed into configuration b.
+int dexpand_algorithm(solver *s, const binconf *b, int item, int depth, int parent)
+{
+    int id = dnode_new(b, false, item, depth, parent);
+
+#if BINS == 3
+    if(gsheuristic(b, item) == 1)
+    {
+	dtree[id].value = 1;
+	return id;
+    }
+#endif
+    for(int i=1; i<=BINS; i++)
+    {
+	// bins of equal load lead to the same configuration
+	if(b->loads[i] + item >= R || (i > 1 && b->loads[i] == b->loads[i-1]))
+	    continue;
+
+	binconf d;
+	duplicate(&d, b);
+	d.loads[i] += item;
+	d.items[item]++;
+	sortloads(&d);
+	rehash(&d, b, item);
+	int child = dexpand_adversary(s, &d, depth+1, id);
+	if(dtree[child].value == 1)
+	{
+	    dtree[id].value = 1;
+	    return id;
+	}
+	if(dtree[child].value == -1)
+	    dtree[id].pending++;
+    }
+    if(dtree[id].pending == 0)
+    {
+	dtree[id].value = 0;
+    }
+    return id;
+}
+
+// Sets the value of a vertex and propagates it towards the root.
+void dnode_resolve(int id, int value)
+{
+    while(id != -1 && dtree[id].value == -1)
+    {
+	dtree[id].value = value;
+	int p = dtree[id].parent;
+	if(p == -1)
+	    return;
+	// the adversary wins with 0, the algorithm wins with 1
+	if(dtree[p].adv ? (value == 0) : (value == 1))
+	{
+	    id = p;
+	    continue;
+	}
+	if(--dtree[p].pending > 0)
+	    return;
+	id = p;
+	value = dtree[p].adv ? 1 : 0;
+    }
+}
+
+// A task is live if neither it nor any of its ancestors is resolved.
+bool dnode_live(int id)
+{
+    for(; id != -1; id = dtree[id].parent)
+    {
+	if(dtree[id].value != -1)
+	    return false;
+    }
+    return true;
+}
+
+void coordinator_send_task(int fd, int id)
+{
+    net_msg m;
+    memset(&m, 0, sizeof(m));
+    m.type = MSG_TASK;
+    m.id = id;
+    m.depth = dtree[id].depth;
+    for(int i=1; i<=BINS; i++)
+	m.loads[i] = dtree[id].bc.loads[i];
+    for(int j=1; j<=S; j++)
+	m.items[j] = dtree[id].bc.items[j];
+    net_send(fd, &m);
+}
+
+/* Runs the coordinator on address addr, splitting the game tree at depth split.
+ * Forks local_workers workers connecting to the same address.
+ * Returns the value of the root: 0 if the adversary wins, 1 if the algorithm wins, -1 on error.
+ */
+int coordinator_main(solver *s, const char *addr, int split, int local_workers)
+{
+    binconf root;
+    net_msg m;
+    int workers[MAX_WORKERS]; // socket of each worker
+    int running[MAX_WORKERS]; // task of each worker, -1 if idle, -2 before hello
+    bool cancel_sent[MAX_WORKERS];
+    int nworkers = 0;
+    llu sent = 0, cancelled = 0;
+
+    int lfd = net_open(addr, true);
+    if(lfd < 0)
+    {
+	fprintf(stderr, "Coordinator: unable to listen on %s.\n", addr);
+	return -1;
+    }
+
+    for(int w=0; w<local_workers; w++)
+    {
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+	    close(lfd);
+	    exit(worker_main(s, addr) == 0 ? 0 : 1);
+	}
+    }
+
+    dsplit = split;
+    init(&root);
+    hashinit(&root);
+    int rootid = dexpand_adversary(s, &root, 0, -1);
+    fprintf(stderr, "Coordinator: %d vertices expanded to depth %d, %d tasks.\n", dtree_len, split, dqueue_len);
+
+    while(dtree[rootid].value == -1)
+    {
+	// hand out tasks to idle workers
+	for(int w=0; w<nworkers; w++)
+	{
+	    if(running[w] != -1)
+		continue;
+	    while(dqueue_pos < dqueue_len && !dnode_live(dqueue[dqueue_pos]))
+		dqueue_pos++;
+	    if(dqueue_pos == dqueue_len)
+		break;
+	    running[w] = dqueue[dqueue_pos++];
+	    cancel_sent[w] = false;
+	    coordinator_send_task(workers[w], running[w]);
+	    sent++;
+	}
+
+	struct pollfd pfds[MAX_WORKERS+1];
+	pfds[0].fd = lfd; pfds[0].events = POLLIN;
+	for(int w=0; w<nworkers; w++)
+	{
+	    pfds[w+1].fd = workers[w]; pfds[w+1].events = POLLIN;
+	}
+	if(poll(pfds, nworkers+1, -1) < 0)
+	{
+	    if(errno == EINTR)
+		continue;
+	    break;
+	}
+
+	if((pfds[0].revents & POLLIN) && nworkers < MAX_WORKERS)
+	{
+	    int fd = accept(lfd, NULL, NULL);
+	    if(fd >= 0)
+	    {
+		workers[nworkers] = fd;
+		running[nworkers] = -2;
+		nworkers++;
+	    }
+	}
+
+	for(int w=nworkers-1; w>=0; w--)
+	{
+	    if(!(pfds[w+1].revents & (POLLIN | POLLHUP | POLLERR)))
+		continue;
+	    bool ok = net_recv(workers[w], &m);
+	    if(ok && m.type == MSG_HELLO)
+	    {
+		net_msg h;
+		net_hello(&h);
+		ok = (running[w] == -2 && m.id == h.id && m.depth == h.depth && m.value == h.value);
+		if(ok)
+		    running[w] = -1;
+		else
+		    fprintf(stderr, "Coordinator: rejecting a worker with different BINS, R or S.\n");
+	    } else if(ok && m.type == MSG_RESULT && m.id == running[w])
+	    {
+		running[w] = -1;
+		if(m.value != -1 && dtree[m.id].value == -1)
+		{
+		    dnode_resolve(m.id, m.value);
+		}
+	    }
+
+	    if(!ok)
+	    {
+		// the worker is gone; return its task to the queue
+		if(running[w] >= 0 && dnode_live(running[w]))
+		{
+		    dqueue[--dqueue_pos] = running[w];
+		}
+		close(workers[w]);
+		workers[w] = workers[nworkers-1];
+		running[w] = running[nworkers-1];
+		cancel_sent[w] = cancel_sent[nworkers-1];
+		nworkers--;
+	    }
+	}
+
+	// cancel running tasks whose result is no longer needed
+	for(int w=0; w<nworkers; w++)
+	{
+	    if(running[w] >= 0 && !cancel_sent[w] && !dnode_live(running[w]))
+	    {
+		memset(&m, 0, sizeof(m));
+		m.type = MSG_CANCEL;
+		m.id = running[w];
+		net_send(workers[w], &m);
+		cancelled++;
+		// the worker stays busy until it answers the cancelled task
+		cancel_sent[w] = true;
+	    }
+	}
+    }
+
+    fprintf(stderr, "Coordinator: %llu tasks sent, %llu cancelled.\n", sent, cancelled);
+
+    memset(&m, 0, sizeof(m));
+    m.type = MSG_QUIT;
+    for(int w=0; w<nworkers; w++)
+    {
+	net_send(workers[w], &m);
+	close(workers[w]);
+    }
+    close(lfd);
+    if(strncmp(addr, "unix:", 5) == 0)
+    {
+	unlink(addr+5);
+    }
+    while(local_workers > 0 && wait(NULL) > 0)
+	local_workers--;
+
+    int ret = dtree[rootid].value;
+    free(dtree); free(dqueue);
+    dtree = NULL; dqueue = NULL;
+    dtree_len = dtree_cap = dqueue_len = dqueue_pos = 0;
+    return ret;
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "hash.h"
+#include "measure.h"
+#include "solver.h"
+
+// Dominance between configurations with the same loads.
+//
+// If the items of a configuration c can be obtained by merging items of a
+// configuration f, every sequence that the offline optimum can pack after c
+// can also be packed after f. With the same loads, the adversary has at least
+// as many options in f as in c. Therefore:
+// - if the algorithm wins in f, it also wins in c,
+// - if the adversary wins in c, it also wins in f.
+//
+// The index (domht) groups the results by their load vector, and the lookup
+// checks whether a stored configuration differs from the query by a single
+// merge of two items.
+
+#ifndef _DOMINANCE_H
+#define _DOMINANCE_H 1
+
+// Returns true if the items of coarse are the items of fine with two items merged into one.
+bool merges_two_items(const binconf *coarse, const binconf *fine)
+{
+    int merged = 0, parts = 0, partsum = 0, changes = 0;
+    for(int j=1; j<=S; j++)
+    {
+	int diff = coarse->items[j] - fine->items[j];
+	if(diff == 0)
+	    continue;
+	if(++changes > 3)
+	    return false;
+	if(diff == 1 && merged == 0)
+	{
+	    merged = j;
+	} else if(diff < 0 && parts - diff <= 2)
+	{
+	    parts -= diff;
+	    partsum -= diff*j;
+	} else {
+	    return false;
+	}
+    }
+    return (merged != 0 && parts == 2 && partsum == merged);
+}
+
+/* Looks for a stored configuration with the same loads which settles d.
+ * Returns -1 (nothing found) or the value of d implied by dominance.
+ */
+int dominance_lookup(solver *s, const binconf *d)
+{
+#ifdef MEASURE
+    s->measure.dom_lookups++;
+#endif
+    binconf *r = s->domht.t[conf_index(&s->domht, d)];
+    while(r != NULL)
+    {
+	if(r->loadhash == d->loadhash && r->generation >= s->domht.valid_from)
+	{
+	    if(r->posvalue == 1 && merges_two_items(d, r))
+	    {
+#ifdef MEASURE
+		s->measure.dom_hits_algorithm++;
+#endif
+		r->accesses++;
+		return 1;
+	    }
+	    if(r->posvalue == 0 && merges_two_items(r, d))
+	    {
+#ifdef MEASURE
+		s->measure.dom_hits_adversary++;
+#endif
+		r->accesses++;
+		return 0;
+	    }
+	}
+	r = r->next;
+    }
+    return -1;
+}
+
+/* Returns the refuting item of a stored win of the adversary which d
+ * dominates, or 0. The adversary wins in d by the same strategy, so the
+ * item refutes d as well.
+ */
+int dominance_refuting_item(solver *s, const binconf *d)
+{
+    binconf *r = s->domht.t[conf_index(&s->domht, d)];
+    while(r != NULL)
+    {
+	if(r->loadhash == d->loadhash && r->generation >= s->domht.valid_from
+	   && r->posvalue == 0 && r->refuting > 0 && merges_two_items(r, d))
+	{
+	    return r->refuting;
+	}
+	r = r->next;
+    }
+    return 0;
+}
+
+// refuting is the item the adversary wins by, as in conf_hashpush_refuting()
+void dominance_push(solver *s, const binconf *d, int posvalue, int refuting)
+{
+    conf_hashpush_refuting(&s->domht, d, posvalue, refuting);
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include "common.h"
 #include "fits.h"
 #include "measure.h"
+#include "alloc.h"
+#include "solver.h"
 
 // which Test procedure are we using
 #define TEST sparse_dynprog_test
@@ -54,28 +56,39 @@ void decodetuple(int *new_tuple, int source, int pos)
 
 // solving using dynamic programming, sparse version, starting with empty instead of full queue
 
-// global binary array of feasibilities used for sparse_dynprog_alternate_test
-int *F;
-int *oldqueue;
-int *newqueue;
+// The queues only hold tuples sorted in decreasing order, so their length is
+// bounded by the number of such tuples, binomial(S+BINS, BINS).
+llu dp_frontier_size()
+{
+    llu size = 1;
+    for(int i=1; i<=BINS; i++)
+    {
+	size = size * (S+i) / i;
+    }
+    return size;
+}
 
-void init_sparse_dynprog()
+// total memory used by the dynamic programming arrays, in bytes
+llu dp_memory()
 {
-    F = calloc(BINARRAY_SIZE,sizeof(int));
-    assert(F!=NULL);
-    
-    oldqueue = calloc(BINARRAY_SIZE,sizeof(int));
-    newqueue = calloc(BINARRAY_SIZE,sizeof(int));
-    assert(oldqueue != NULL && newqueue != NULL);
+    return large_alloc_footprint(BINARRAY_SIZE*sizeof(char)) + 2*large_alloc_footprint(dp_frontier_size()*sizeof(int));
+}
+
+// Allocates the binary array of feasibilities and the queues of s.
+void init_sparse_dynprog(solver *s)
+{
+    s->F = large_alloc(BINARRAY_SIZE*sizeof(char));
+    s->oldqueue = large_alloc(dp_frontier_size()*sizeof(int));
+    s->newqueue = large_alloc(dp_frontier_size()*sizeof(int));
 
 }
 
-void free_sparse_dynprog()
+void free_sparse_dynprog(solver *s)
 {
-    free(oldqueue); free(newqueue);
-    free(F);
+    large_free(s->oldqueue); large_free(s->newqueue);
+    large_free(s->F);
 }
-bool sparse_dynprog_test(const binconf *conf)
+bool sparse_dynprog_test(solver *s, const binconf *conf)
 {
     // binary array of feasibilities
     // int f[S+1][S+1][S+1] = {0};
@@ -85,9 +98,11 @@ bool sparse_dynprog_test(const binconf *conf)
     int **swapper;
 
     int *tuple; tuple = calloc(BINS, sizeof(int));
+    int newtuple[BINS];
     
-    poldq = &oldqueue;
-    pnewq = &newqueue;
+    char *F = s->F;
+    poldq = &s->oldqueue;
+    pnewq = &s->newqueue;
     
     int oldqueuelen = 0, newqueuelen = 0;
     
@@ -119,21 +134,30 @@ bool sparse_dynprog_test(const binconf *conf)
 		    
 		    F[index] = 0;
 		    
-		    // try and place the item
+		    // try and place the item; bins of equal load are symmetric
 		    for(int i=0; i < BINS; i++)
 		    {
-			if(tuple[i] + size > S) {
+			if(tuple[i] + size > S || (i > 0 && tuple[i] == tuple[i-1])) {
 			    continue;
 			}
 			
-			tuple[i] += size;
-			int newindex = encodetuple(tuple,0);
+			// keep the new tuple sorted in decreasing order
+			for(int l=0; l < BINS; l++) {
+			    newtuple[l] = tuple[l];
+			}
+			newtuple[i] += size;
+			for(int j=i; j > 0 && newtuple[j-1] < newtuple[j]; j--) {
+			    int helper = newtuple[j];
+			    newtuple[j] = newtuple[j-1];
+			    newtuple[j-1] = helper;
+			}
+			int newindex = encodetuple(newtuple,0);
 
 			// debug assertions
 			if( ! (newindex <= BINARRAY_SIZE) && (newindex >= 0))
 			{
 			    fprintf(stderr, "Tuple and index %d are weird.\n", newindex);
-			    print_tuple(tuple);
+			    print_tuple(newtuple);
 			    exit(-1);
 			}
 			
@@ -142,7 +166,6 @@ bool sparse_dynprog_test(const binconf *conf)
 			    F[newindex] = 1;
 			    (*pnewq)[newqueuelen++] = newindex;
 			}
-			tuple[i] -= size;
 		    }
 		}
 		if (newqueuelen == 0) {
@@ -157,7 +180,7 @@ bool sparse_dynprog_test(const binconf *conf)
 	    k--;
 	}
 	
-	// last pass, to zero the global array
+	// last pass, to zero the array of feasibilities
 	for(int i=0; i<oldqueuelen; i++)
 	{
 	    index = (*poldq)[i];
@@ -171,10 +194,10 @@ bool sparse_dynprog_test(const binconf *conf)
 
 // a wrapper that hashes the new configuration and if it is not in cache, runs TEST
 // it edits h but should return it to original state (due to Zobrist hashing)
-bool hash_and_test(binconf *h, int item)
+bool hash_and_test(solver *s, binconf *h, int item)
 {
 #ifdef MEASURE
-    test_counter++;
+    s->measure.test_counter++;
 #endif
     
     bool feasible;
@@ -184,16 +207,16 @@ bool hash_and_test(binconf *h, int item)
     h->items[item]++;
     dp_rehash(h,item);
     
-    hashedvalue = dp_hashed(h);
+    hashedvalue = dp_hashed(&s->dpht, h);
     if (hashedvalue != -1)
     {
 	DEBUG_PRINT("Found a cached value of hash %llu in dynprog instance: %d.\n", h->itemhash, hashedvalue);
 	feasible = (bool) hashedvalue;
     } else {
 	DEBUG_PRINT("Nothing found in dynprog cache for hash %llu.\n", h->itemhash);
-	feasible = TEST(h);
+	feasible = TEST(s, h);
 	DEBUG_PRINT("Pushing dynprog value %d for hash %llu.\n", feasible, h->itemhash);
-	dp_hashpush(h,feasible);
+	dp_hashpush(&s->dpht, h, feasible);
     }
 
     h->items[item]--;
@@ -201,10 +224,10 @@ bool hash_and_test(binconf *h, int item)
     return feasible;
 }
 
-void maximum_feasible_dynprog(const binconf *b, int *res)
+void maximum_feasible_dynprog(solver *s, const binconf *b, int *res)
 {
 #ifdef MEASURE
-    maximum_feasible_counter++;
+    s->measure.maximum_feasible_counter++;
 #endif
     DEBUG_PRINT("Starting dynprog maximization of configuration:\n");
     DEBUG_PRINT_BINCONF(b);
@@ -241,7 +264,7 @@ void maximum_feasible_dynprog(const binconf *b, int *res)
     bool feasible;
     while (lb < ub)
     {
-	feasible = hash_and_test(&h,mid);
+	feasible = hash_and_test(s, &h,mid);
 	if(feasible)
 	{
 	    lb = mid;
@@ -256,16 +279,16 @@ void maximum_feasible_dynprog(const binconf *b, int *res)
     */
 
     //assert(ub >= lb);
-    //assert(hash_and_test(&h,lb) == true);
+    //assert(hash_and_test(s, &h,lb) == true);
     //if(lb != maxvalue)
-    //    assert(hash_and_test(&h,lb+1) == false);
+    //    assert(hash_and_test(s, &h,lb+1) == false);
     
     
 
     // DEBUG: compare it with ordinary for cycle
     for (dynitem=maxvalue; dynitem>bestfitvalue; dynitem--)
     {
-	bool feasible = hash_and_test(&h,dynitem);
+	bool feasible = hash_and_test(s, &h,dynitem);
 	if(feasible)
 	{
 	    break;
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdbool.h>
 
 #include "common.h"
 #include "hash.h"
@@ -88,85 +89,63 @@ int worstfit(binconf *ret, const binconf *orig) {
     return 1;
 }
 
-// Finds the maximum size of two items that can be sent if we pack using Best Fit Decreasing.
-// Inserts the numbers into res[0], res[1]. Returns 0 if heuristic cannot be used.
-int maxtwo(const binconf *b, int *res)
+// Finds the k largest items that the offline optimum can still accept, taking
+// the free space of the bins of a Best Fit Decreasing (worst == false) or
+// Worst Fit Decreasing (worst == true) packing. If k > BINS, the largest
+// remainders are split in halves until there are k items.
+// Inserts the sizes into res[0] >= res[1] >= ... >= res[k-1]; res needs
+// space for at least max(k,BINS) numbers.
+// Returns 0 if heuristic cannot be used.
+int maxk(const binconf *b, int *res, int k, bool worst)
 {
     binconf h;
-    int k = bestfit(&h, b);
-    int remainder;
-    if(k == 0)
+    int valid = worst ? worstfit(&h, b) : bestfit(&h, b);
+    int remainder, helper;
+    if(valid == 0)
     {
 	return 0;
     }
 
-    // the offline configuration returned by BFD is feasible, return the values.
-    res[0] = -1;
-    res[1] = -1;
-    for (int bin = 1; bin <= 3; bin++)
+    // the offline configuration returned by BFD/WFD is feasible, insertsort the remainders.
+    for(int bin=1; bin<=BINS; bin++)
     {
 	remainder = S - h.loads[bin];
-	if(remainder > res[0])
+	int pos = bin-1;
+	while(pos > 0 && res[pos-1] < remainder)
 	{
-	    res[1] = res[0];
-	    res[0] = remainder;
-	} else if(remainder > res[1]) {
-	    res[1] = remainder;
+	    res[pos] = res[pos-1];
+	    pos--;
 	}
+	res[pos] = remainder;
     }
 
-    // check if one remainder is 0 -- in this case, we are inserting a zero-size item, which
-    // we consider a case where the heuristic fails
-    if(res[1] == 0)
+    // split the largest remainder so that we have k items
+    for(int count=BINS; count < k; count++)
     {
-	return 0;
-    }
-    return 1;
-}
-
-// Finds the maximum size of three items that can be sent if we pack using Worst Fit Decreasing.
-// Inserts the numbers into res[0], res[1], res[2]. Returns 0 if heuristic cannot be used.
-int maxthree(const binconf *b, int *res)
-{
-    binconf h;
-    int k = worstfit(&h, b);
-    int remainder;
-    if(k == 0)
-    {
-	return 0;
-    }
-
-    // the offline configuration returned by BFD is feasible, return the values.
-    res[0] = -1;
-    res[1] = -1;
-    res[2] = -1;
-    for(int bin=1; bin <= 3; bin++)
-    {
-	remainder = S - h.loads[bin];
-	DEBUG_PRINT("Maxthree: remainder is %d\n", remainder);
-	if(remainder > res[0])
+	helper = res[0];
+	res[0] = (helper+1)/2;
+	res[count] = helper/2;
+	// insertsort the two halves back into decreasing order
+	for(int i=1; i<=count; i++)
 	{
-	    res[2] = res[1];
-	    res[1] = res[0];
-	    res[0] = remainder;
-	} else if(remainder > res[1]) { 
-	    res[2] = res[1];
-	    res[1] = remainder;
-	} else if(remainder > res[2]) {
-	    res[2] = remainder;
+	    helper = res[i];
+	    int pos = i;
+	    while(pos > 0 && res[pos-1] < helper)
+	    {
+		res[pos] = res[pos-1];
+		pos--;
+	    }
+	    res[pos] = helper;
 	}
-	DEBUG_PRINT("Maxthree: after placing remainder, return values are (%d,%d,%d)\n", res[0],res[1],res[2]);
-
     }
 
-    // check if one remainder is 0 -- in this case, we are inserting a zero-size item, which
+    // check if one item is 0 -- in this case, we are inserting a zero-size item, which
     // we consider a case where the heuristic fails
-    if(res[2] == 0)
+    if(res[k-1] <= 0)
     {
 	return 0;
     }
     return 1;
-
 }
 
 // Finds the maximum size of an item that can be sent if we pack using Best Fit Decreasing.
@@ -3,6 +3,7 @@
 #include <assert.h>
 #include "common.h"
 #include "measure.h"
+#include "alloc.h"
 
 #ifndef _HASH_H
 #define _HASH_H 1
@@ -10,17 +11,57 @@
 /* Hashing routines.
  */
 
+// The Zobrist tables are read-only after zobrist_init(), shared by all solvers.
 llu **Zi; // Zobrist table for items
 llu **Zl; // Zobrist table for loads
 
-// generic hash table (for configurations)
-binconf **ht;
-
-// output hash table (needs to be different)
-binconf **outht;
+// A configuration hash table: an array of chains of binconfs.
+// The table persists over evaluate() calls; each call starts a new generation,
+// and entries of generations older than valid_from are treated as empty.
+struct conf_hashtable {
+    binconf **t;
+    llu size; // number of buckets, a power of two
+    int chainlen; // maximum length of a chain, at most CHAINLEN
+    llu entries; // number of stored configurations
+    llu peak; // maximum of entries over the run
+    bool byloads; // indexed by the load hash only (the dominance index)
+    unsigned int generation; // current generation
+    unsigned int valid_from; // oldest generation which is not stale
+    llu reused; // hits on entries stored in earlier generations
+};
+
+typedef struct conf_hashtable conf_hashtable;
 
 // hash table for dynamic programming calls / feasibility checks
-dp_hash_item **dpht;
+struct dp_hashtable {
+    dp_hash_item **t;
+    llu size;
+    int chainlen;
+    llu entries;
+    llu peak;
+};
+
+typedef struct dp_hashtable dp_hashtable;
+
+// An exact map from configurations to non-negative values, by open addressing.
+// Unlike the caches above it never evicts and grows instead; it is used where
+// a lost entry would duplicate a whole subtree, e.g. by the output.
+struct conf_map_entry {
+    llu loadhash;
+    llu itemhash;
+    int value; // -1 if the slot is empty
+};
+
+typedef struct conf_map_entry conf_map_entry;
+
+struct conf_map {
+    conf_map_entry *t;
+    llu size; // number of slots, a power of two
+    llu entries;
+    llu peak;
+};
+
+typedef struct conf_map conf_map;
 
 /* Reads random 64 bits on a Unix machine.
    Does not work elsewhere.
@@ -46,86 +87,66 @@ void zobrist_init()
     Zi = malloc((S+1)*sizeof(llu *));
     Zl = malloc((BINS+1)*sizeof(llu *)); //TODO: make the 3 a generic number
 
+    // one stream for all the entries, opening /dev/urandom for each is slow
+    FILE *ur = fopen("/dev/urandom", "r");
+    assert(ur != NULL);
+    size_t rv = 0;
     for(int i=1; i<=BINS; i++)
     {
 	Zl[i] = malloc((R+1)* sizeof(llu));
-	for(int j=0; j<=R; j++)
-	{
-	    Zl[i][j] = rand_64bit();
-	}	
+	rv += fread(Zl[i], sizeof(llu), R+1, ur);
     }
     
     
     for(int i=1; i<=S; i++) // different sizes of items
     {
 	Zi[i] = malloc((R+1)*BINS*sizeof(llu));
-	
-	for(int j=0; j<=R*BINS; j++) // number of items of this size
-	{
-	    Zi[i][j] = rand_64bit(); 
-	}
+	// the number of items of this size is at most R*BINS
+	rv += fread(Zi[i], sizeof(llu), R*BINS+1, ur);
     }
+    fclose(ur);
+    assert(rv == (size_t) (BINS*(R+1) + S*(R*BINS+1)));
 }
 
-void global_hashtable_init()
+// Allocates an empty table of hashtable->size buckets; large_alloc() returns zeroed memory.
+void conf_hashtable_alloc(conf_hashtable *hashtable)
 {
+    hashtable->t = large_alloc(hashtable->size * sizeof(binconf *));
+    hashtable->entries = 0;
+    hashtable->generation = hashtable->valid_from = 0;
+}
 
-    dpht = malloc(HASHSIZE * sizeof(dp_hash_item *));
-    assert(dpht != NULL);
-    outht = malloc(HASHSIZE * sizeof(binconf *));
-    assert(outht != NULL);
-    for(int i=0; i< HASHSIZE; i++)
-    {
-	outht[i] = NULL;
-	dpht[i] = NULL;
-    }
-    zobrist_init();
-    measure_init();
+// Starts a new generation; the stored results stay valid.
+void conf_hashtable_new_generation(conf_hashtable *hashtable)
+{
+    hashtable->generation++;
 }
 
-void local_hashtable_init()
+// Empties the table in O(1): all stored entries become stale.
+void conf_hashtable_invalidate(conf_hashtable *hashtable)
 {
-    ht = malloc(HASHSIZE * sizeof(binconf *));
-    assert(ht != NULL);
-    //assert(dpht != NULL);
-    for(int i=0; i< HASHSIZE; i++)
-    {
-	ht[i] = NULL;
-	//dpht[i] = NULL;
-    }
+    hashtable->generation++;
+    hashtable->valid_from = hashtable->generation;
 }
 
-void global_hashtable_cleanup()
+// Frees all configurations in the table and the table itself.
+void conf_hashtable_free(conf_hashtable *hashtable)
 {
     int c;
-    // zobrist cleanup
-    for(int i=1; i<=BINS; i++)
-    {
-	free(Zl[i]);
-    }
-
-    for(int j=1; j<=S; j++)
-    {
-	free(Zi[j]);
-    }
-    free(Zl);
-    free(Zi);
-
     binconf *x, *p;
-    //hashtable output cleanup
-    for(int k=0; k< HASHSIZE; k++)
+    for(llu k=0; k < hashtable->size; k++)
     {
 	c=0;
-	x = outht[k];
+	x = hashtable->t[k];
 	// counting objects for debug purposes
 	while(x != NULL)
 	{
 	    x = x->next;
 	    c++;
 	}
-	assert(c<=CHAINLEN);
+	assert(c<=hashtable->chainlen);
 	// removing objects
-	x = outht[k];
+	x = hashtable->t[k];
 	while(x != NULL)
 	{
 	    p = x->next;
@@ -134,21 +155,49 @@ void global_hashtable_cleanup()
 	}
     }
 
-    // dynamic programming hash table cleanup
+    large_free(hashtable->t);
+    hashtable->t = NULL;
+    hashtable->entries = 0;
+}
+
+void zobrist_free()
+{
+    for(int i=1; i<=BINS; i++)
+    {
+	free(Zl[i]);
+    }
+
+    for(int j=1; j<=S; j++)
+    {
+	free(Zi[j]);
+    }
+    free(Zl);
+    free(Zi);
+}
+
+void dp_hashtable_alloc(dp_hashtable *hashtable)
+{
+    hashtable->t = large_alloc(hashtable->size * sizeof(dp_hash_item *));
+    hashtable->entries = 0;
+}
+
+void dp_hashtable_free(dp_hashtable *hashtable)
+{
+    int c;
     dp_hash_item *dp_item, *dp_pointer;
-    for(int k=0; k< HASHSIZE; k++)
+    for(llu k=0; k< hashtable->size; k++)
     {
 	c=0;
-	dp_item = dpht[k];
+	dp_item = hashtable->t[k];
 	// counting objects for debug purposes
 	while(dp_item != NULL)
 	{
 	    dp_item = dp_item->next;
 	    c++;
 	}
-	assert(c<=CHAINLEN);
+	assert(c<=hashtable->chainlen);
 	// removing objects
-	dp_item = dpht[k];
+	dp_item = hashtable->t[k];
 	while(dp_item != NULL)
 	{
 	    dp_pointer = dp_item->next;
@@ -157,56 +206,27 @@ void global_hashtable_cleanup()
 	}
     }
 
-    free(dpht);
-    free(outht); 
+    large_free(hashtable->t);
+    hashtable->t = NULL;
+    hashtable->entries = 0;
 }
 
-// cleanup function -- technically not necessary but useful for memory leak checking
-void local_hashtable_cleanup()
-{
-    int c;
-    
-    //hashtable cleanup
-    binconf *x, *p;
-    for(int k=0; k< HASHSIZE; k++)
-    {
-	c=0;
-	x = ht[k];
-	// counting objects for debug purposes
-	while(x != NULL)
-	{
-	    x = x->next;
-	    c++;
-	}
-	assert(c<=CHAINLEN);
-	// removing objects
-	x = ht[k];
-	while(x != NULL)
-	{
-	    p = x->next;
-	    free(x);
-	    x = p;
-	}
-    }
-
-    free(ht);
-}
 // Few debug functions.
-void hashtable_print()
+void hashtable_print(const conf_hashtable *hashtable)
 {
-    for(int i=0; i<HASHSIZE; i++)
+    for(llu i=0; i<hashtable->size; i++)
     {
-	if(ht[i] != NULL)
+	if(hashtable->t[i] != NULL)
 	{
 	    int c = 0;
 	    binconf *p;
-	    p = ht[i];
+	    p = hashtable->t[i];
 	    while(p != NULL)
 	    {
 		p = p->next;
 		c++;
 	    }
-	    fprintf(stderr, "ht[%d] is occupied with %d elements.\n", i, c);
+	    fprintf(stderr, "ht[%llu] is occupied with %d elements.\n", i, c);
 	}
     }
 }
@@ -240,13 +260,10 @@ void printBits64(llu num)
    fprintf(stderr, "\n");
 }
 
-/* returns a lower HASHLOG bits of a 64-bit number */
-unsigned int lowerpart(llu x)
+/* returns the lower bits of a 64-bit number, as an index into a table of size buckets */
+llu lowerpart(llu x, llu size)
 {
-    llu mask,y;
-    mask = (HASHSIZE) - 1;
-    y = (x) & mask;
-    return (unsigned int) y;
+    return x & (size - 1);
 }
 
 // calculates the hash of b completely.
@@ -306,18 +323,32 @@ void dp_unhash(binconf *d, int dynitem)
     d->itemhash ^= Zi[dynitem][d->items[dynitem]];
 }
 
+// bucket of a configuration in a configuration hash table
+llu conf_index(const conf_hashtable *hashtable, const binconf *d)
+{
+    if(hashtable->byloads)
+    {
+	return lowerpart(d->loadhash, hashtable->size);
+    }
+    return lowerpart(d->itemhash ^ d->loadhash, hashtable->size);
+}
+
 /* Checks if an element is hashed, returns -1 (not hashed)
    or 0/1 if it is. */
-int is_conf_hashed(binconf **hashtable, const binconf *d)
+int is_conf_hashed(conf_hashtable *hashtable, const binconf *d)
 {
-    int lp = lowerpart(d->itemhash ^ d->loadhash);
+    llu lp = conf_index(hashtable, d);
     binconf *r;
-    r = hashtable[lp];
+    r = hashtable->t[lp];
     while(r != NULL)
     {
-	if (r->loadhash == d->loadhash && r->itemhash == d->itemhash)
+	if (r->loadhash == d->loadhash && r->itemhash == d->itemhash && r->generation >= hashtable->valid_from)
 	{
 	    r->accesses++;
+	    if(r->generation < hashtable->generation)
+	    {
+		hashtable->reused++;
+	    }
 #ifdef VERBOSE
 	    fprintf(stderr, "Found the following position in a hash table:\n");
 	    print_binconf(d);
@@ -329,10 +360,27 @@ int is_conf_hashed(binconf **hashtable, const binconf *d)
     return -1;
 }
 
-/* Adds an element to a configuration hash.
+/* Returns the refuting item stored with d, a configuration won by the adversary,
+   or 0 if d is not hashed or its item is not known. */
+int conf_refuting_item(const conf_hashtable *hashtable, const binconf *d)
+{
+    binconf *r = hashtable->t[conf_index(hashtable, d)];
+    while(r != NULL)
+    {
+	if (r->loadhash == d->loadhash && r->itemhash == d->itemhash && r->generation >= hashtable->valid_from)
+	{
+	    return (r->posvalue == 0) ? r->refuting : 0;
+	}
+	r = r->next;
+    }
+    return 0;
+}
+
+/* Adds an element to a configuration hash; refuting is the item the
+ * adversary wins by, if posvalue is 0 and the item is known, or 0.
  */
 
-void conf_hashpush(binconf** hashtable, const binconf *d, int posvalue)
+void conf_hashpush_refuting(conf_hashtable *hashtable, const binconf *d, int posvalue, int refuting)
 {
     binconf *e, *t, *p, *minac;
     int c;
@@ -340,24 +388,29 @@ void conf_hashpush(binconf** hashtable, const binconf *d, int posvalue)
     init(e);
     duplicate(e,d);
     e->posvalue = posvalue;
-    unsigned int lp = lowerpart(e->loadhash ^ e->itemhash);
+    e->refuting = (char) refuting;
+    e->generation = hashtable->generation;
+    llu lp = conf_index(hashtable, e);
 #ifdef VERBOSE
     fprintf(stderr, "Hashing the following position with value %d:\n", posvalue);
     print_binconf(d);
 #endif
     
-#ifdef VERBOSE
-    printBits32(lp);
-#endif
-    t = hashtable[lp];
-    if(t == NULL)
+    t = hashtable->t[lp];
+    if(t == NULL || hashtable->chainlen == 1)
     {
-	hashtable[lp] = e;
+	if(t != NULL)
+	{
+	    free(t);
+	    hashtable->entries--;
+	}
+	hashtable->t[lp] = e;
 	e->accesses = 0;
+	hashtable->entries++;
     } else {
-	t = hashtable[lp];
+	t = hashtable->t[lp];
 	c = 1;
-	while((c < (CHAINLEN-1)) && t->next!=NULL)
+	while((c < (hashtable->chainlen-1)) && t->next!=NULL)
 	{
 	    t = t->next;
 	    c++;
@@ -366,28 +419,35 @@ void conf_hashpush(binconf** hashtable, const binconf *d, int posvalue)
 	if(t->next == NULL)
 	{
 	    t->next = e;
+	    hashtable->entries++;
 	} else {
 	    // check for the item with the least number of accesses
 #ifdef VERBOSE
 	    fprintf(stderr, "We have to remove an element.\n");
 #endif	    
-	    p = hashtable[lp];
-	    minac = hashtable[lp];
+	    // stale entries are removed first
+	    p = hashtable->t[lp];
+	    minac = hashtable->t[lp];
 	    while(p != NULL)
 	    {
+		if(p->generation < hashtable->valid_from)
+		{
+		    minac = p;
+		    break;
+		}
 		if(p->accesses < minac->accesses)
 		    minac = p;
 		p = p->next;
 	    }
 
 	    // remove the item with the least number of accesses
-	    p = hashtable[lp];
+	    p = hashtable->t[lp];
 	    int k = 1;
 	    if(minac == p)
 	    {
-		e->next = hashtable[lp]->next;
-		free(hashtable[lp]);
-		hashtable[lp] = e;
+		e->next = hashtable->t[lp]->next;
+		free(hashtable->t[lp]);
+		hashtable->t[lp] = e;
 #ifdef VERBOSE
 		fprintf(stderr, "Element removed is %d\n", k);
 #endif
@@ -407,14 +467,112 @@ void conf_hashpush(binconf** hashtable, const binconf *d, int posvalue)
 	}
 	
     }
+
+    if(hashtable->entries > hashtable->peak)
+    {
+	hashtable->peak = hashtable->entries;
+    }
+}
+
+void conf_hashpush(conf_hashtable *hashtable, const binconf *d, int posvalue)
+{
+    conf_hashpush_refuting(hashtable, d, posvalue, 0);
+}
+
+// initial number of slots of a conf_map
+#define CONF_MAP_MINSIZE 1024
+
+void conf_map_alloc_slots(conf_map *map, llu size)
+{
+    map->t = malloc(size * sizeof(conf_map_entry));
+    assert(map->t != NULL);
+    map->size = size;
+    for(llu k = 0; k < size; k++)
+    {
+	map->t[k].value = -1;
+    }
+}
+
+void conf_map_init(conf_map *map)
+{
+    conf_map_alloc_slots(map, CONF_MAP_MINSIZE);
+    map->entries = 0;
+    map->peak = 0;
+}
+
+void conf_map_free(conf_map *map)
+{
+    free(map->t);
+    map->t = NULL;
+    map->size = 0;
+    map->entries = 0;
+}
+
+// Empties the map, keeping its slots.
+void conf_map_clear(conf_map *map)
+{
+    for(llu k = 0; k < map->size; k++)
+    {
+	map->t[k].value = -1;
+    }
+    map->entries = 0;
+}
+
+// the slot of d, or the empty slot where it belongs
+conf_map_entry* conf_map_slot(const conf_map *map, llu loadhash, llu itemhash)
+{
+    llu k = lowerpart(loadhash ^ itemhash, map->size);
+    while(map->t[k].value != -1 && (map->t[k].loadhash != loadhash || map->t[k].itemhash != itemhash))
+    {
+	k = lowerpart(k + 1, map->size);
+    }
+    return &map->t[k];
+}
+
+// Returns the value of d, or -1 if it is not in the map.
+int conf_map_get(const conf_map *map, const binconf *d)
+{
+    return conf_map_slot(map, d->loadhash, d->itemhash)->value;
+}
+
+// Sets the value of d; the map doubles when it gets half full.
+void conf_map_put(conf_map *map, const binconf *d, int value)
+{
+    assert(value >= 0);
+    if(2*(map->entries + 1) > map->size)
+    {
+	conf_map_entry *old = map->t;
+	llu oldsize = map->size;
+	conf_map_alloc_slots(map, 2*oldsize);
+	for(llu k = 0; k < oldsize; k++)
+	{
+	    if(old[k].value != -1)
+	    {
+		*conf_map_slot(map, old[k].loadhash, old[k].itemhash) = old[k];
+	    }
+	}
+	free(old);
+    }
+
+    conf_map_entry *e = conf_map_slot(map, d->loadhash, d->itemhash);
+    if(e->value == -1)
+    {
+	e->loadhash = d->loadhash;
+	e->itemhash = d->itemhash;
+	if(++map->entries > map->peak)
+	{
+	    map->peak = map->entries;
+	}
+    }
+    e->value = value;
 }
 
 // Checks if a number is in the dynamic programming hash.
 // Returns -1 (not hashed) and 0/1 (it is hashed, this is its feasibility)
-int dp_hashed(const binconf* b)
+int dp_hashed(const dp_hashtable *dpht, const binconf* b)
 {
-    unsigned int lp = lowerpart(b->itemhash);
-    dp_hash_item *p = dpht[lp];
+    llu lp = lowerpart(b->itemhash, dpht->size);
+    dp_hash_item *p = dpht->t[lp];
     while( p != NULL)
     {
 	if(p->itemhash == b->itemhash)
@@ -432,22 +590,28 @@ int dp_hashed(const binconf* b)
 
 
 // Adds an number to a dynamic programming hash table
-void dp_hashpush(const binconf *d, bool feasible)
+void dp_hashpush(dp_hashtable *dpht, const binconf *d, bool feasible)
 {
     dp_hash_item *e, *t, *p, *minac;
     int c;
     e = malloc(sizeof(dp_hash_item)); assert(e != NULL);
     dp_hash_init(e,d,feasible);
-    unsigned int lp = lowerpart(e->itemhash);
+    llu lp = lowerpart(e->itemhash, dpht->size);
     
-    t = dpht[lp];
-    if(t == NULL)
+    t = dpht->t[lp];
+    if(t == NULL || dpht->chainlen == 1)
     {
-	dpht[lp] = e;
+	if(t != NULL)
+	{
+	    free(t);
+	    dpht->entries--;
+	}
+	dpht->t[lp] = e;
+	dpht->entries++;
     } else {
-	t = dpht[lp];
+	t = dpht->t[lp];
 	c = 1;
-	while((c < (CHAINLEN-1)) && t->next!=NULL)
+	while((c < (dpht->chainlen-1)) && t->next!=NULL)
 	{
 	    t = t->next;
 	    c++;
@@ -456,13 +620,14 @@ void dp_hashpush(const binconf *d, bool feasible)
 	if(t->next == NULL)
 	{
 	    t->next = e;
+	    dpht->entries++;
 	} else {
 	    // check for the item with the least number of accesses
 #ifdef VERBOSE
 	    fprintf(stderr, "DPHT: We have to remove an element.\n");
 #endif	    
-	    p = dpht[lp];
-	    minac = dpht[lp];
+	    p = dpht->t[lp];
+	    minac = dpht->t[lp];
 	    while(p != NULL)
 	    {
 		if(p->accesses < minac->accesses)
@@ -471,13 +636,13 @@ void dp_hashpush(const binconf *d, bool feasible)
 	    }
 
 	    // remove the item with the least number of accesses
-	    p = dpht[lp];
+	    p = dpht->t[lp];
 	    int k = 1;
 	    if(minac == p)
 	    {
-		e->next = dpht[lp]->next;
-		free(dpht[lp]);
-		dpht[lp] = e;
+		e->next = dpht->t[lp]->next;
+		free(dpht->t[lp]);
+		dpht->t[lp] = e;
 #ifdef VERBOSE
 		fprintf(stderr, "DPHT: Element removed is %d\n", k);
 #endif
@@ -498,6 +663,10 @@ void dp_hashpush(const binconf *d, bool feasible)
 	
     }
 
+    if(dpht->entries > dpht->peak)
+    {
+	dpht->peak = dpht->entries;
+    }
 }
 
 #endif
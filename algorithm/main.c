@@ -1,25 +1,46 @@
+// sockets and other POSIX extensions are not part of -std=c11
+#define _GNU_SOURCE 1
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "common.h"
 #include "hash.h"
 #include "minimax.h"
 #include "measure.h"
+#include "distributed.h"
+#include "memory.h"
+#include "certificate.h"
+#include "minimize.h"
+#include "pn.h"
+#include "retro.h"
+#include "threshold.h"
+#include "daemon.h"
+#include "batch.h"
 
-// evaluates the configuration b, stores the result
+// evaluates the configuration b by solver s, stores the result
 // in gametree t (t = NULL if result is 1.
-int evaluate(binconf *b, gametree **rettree, int depth)
+int evaluate(solver *s, binconf *b, gametree **rettree, int depth)
 {
     gametree *t;
     
-    local_hashtable_init();
+    local_hashtable_init(s);
     //zobrist_init();
     //measure_init();
     hashinit(b);
+
+    if(engine == ENGINE_PN)
+    {
+	return pn_evaluate(s, b, rettree, depth);
+    } else if(engine == ENGINE_RETRO)
+    {
+	return retro_evaluate(s, b, rettree, depth);
+    }
     
     t = malloc(sizeof(gametree));
-    init_gametree_vertex(t, b, 0, depth-1);
+    init_gametree_vertex(s, t, b, 0, depth-1);
     
-    int ret = adversary(b, 0, t, 1);
+    int ret = adversary(s, b, 0, t, 1);
     if(ret == 0)
     {
 	(*rettree) = t->next[1];
@@ -29,34 +50,61 @@ int evaluate(binconf *b, gametree **rettree, int depth)
 	delete_gametree(t);
     }
     
-    local_hashtable_cleanup();
     return ret;
 }
 
-// prints a game tree
-// needs to be here because it calls evaluate when dealing with cache
-void print_gametree(gametree *tree)
+/* Coarse-to-fine search: evaluates b with item_step = step, step/2, ..., 1
+ * and stops at the first pass won by the adversary, whose tree is a lower
+ * bound of the full game. Wins of the adversary found by the coarser passes
+ * stay in the cache and prune the finer ones. Reports the time of each pass.
+ */
+int coarse_evaluate(solver *s, binconf *b, gametree **rettree, int depth, int step)
+{
+    int ret;
+    struct timeval start, end, diff;
+    for(s->item_step = step; ; s->item_step /= 2)
+    {
+	gettimeofday(&start, NULL);
+	if(engine == ENGINE_PN)
+	{
+	    pn_reset(s);
+	} else if(engine == ENGINE_RETRO)
+	{
+	    retro_free();
+	}
+	ret = evaluate(s, b, rettree, depth);
+	gettimeofday(&end, NULL);
+	timeval_subtract(&diff, &end, &start);
+	fprintf(stderr, "Item step %d: %s in %ld.%06ld s.\n", s->item_step,
+		ret == 0 ? "won by the adversary" : "won by the algorithm", (long) diff.tv_sec, (long) diff.tv_usec);
+	if(ret == 0 || s->item_step == 1)
+	    break;
+    }
+    return ret;
+}
+
+// prints a game tree to out; cached vertices are expanded by expand_cached()
+void print_gametree(solver *s, FILE *out, gametree *tree)
 {
-    binconf *b;
     assert(tree != NULL);
 
     /* Mark the current bin configuration as present in the output. */
-    conf_hashpush(outht, tree->bc, 1);
+    conf_map_put(&s->outht, tree->bc, 1);
     //assert(tree->cached != 1);
     
     if(tree->leaf)
     {
-	//fprintf(stdout, "%llu [label=\"leaf depth %d\"];\n", tree->id, tree->depth);
+	//fprintf(out, "%llu [label=\"leaf depth %d\"];\n", tree->id, tree->depth);
 	return;
     } else {
-	fprintf(stdout, "%llu [label=\"", tree->id);
+	fprintf(out, "%llu [label=\"", tree->id);
 	for(int i=1; i<=BINS; i++)
 	{
-	    fprintf(stdout, "%d\\n", tree->bc->loads[i]);
+	    fprintf(out, "%d\\n", tree->bc->loads[i]);
 	    
 	}
 
-	fprintf(stdout, "n: %d\"];\n", tree->nextItem);
+	fprintf(out, "n: %d\"];\n", tree->nextItem);
 
 
 	for(int i=1;i<=BINS; i++)
@@ -66,7 +114,7 @@ void print_gametree(gametree *tree)
 
 	    /* If the next configuration is already present in the output */
 
-	    if (is_conf_hashed(outht, tree->next[i]->bc) != -1)
+	    if (conf_map_get(&s->outht, tree->next[i]->bc) != -1)
 	    {
 		fprintf(stderr, "The configuration is present elsewhere in the tree:"); 
 		print_binconf(tree->next[i]->bc);
@@ -77,56 +125,401 @@ void print_gametree(gametree *tree)
 	    
 	    if(tree->next[i]->cached == 1)
 	    {
-		b = malloc(sizeof(binconf));
-		init(b);
-		duplicate(b, tree->next[i]->bc);
-		delete_gametree(tree->next[i]);
-		evaluate(b, &(tree->next[i]), tree->depth+1);
-		free(b);
+		expand_cached(s, &(tree->next[i]));
 	    }
 	    
 	    if(tree->next[i]->leaf != 1)
 	    {
-		fprintf(stdout, "%llu -> %llu\n", tree->id, tree->next[i]->id);	
-		print_gametree(tree->next[i]);
+		fprintf(out, "%llu -> %llu\n", tree->id, tree->next[i]->id);	
+		print_gametree(s, out, tree->next[i]);
 	    }
 	}
 	
     }
 }
 
-int main(void)
+// Prints the counters of solver s, if MEASURE is defined.
+void measure_print(solver *s)
 {
+    measure_counters *m = &s->measure;
+#ifdef MEASURE
+    long double ratio = (long double) m->test_counter / (long double) m->maximum_feasible_counter;
+#endif
+    MEASURE_PRINT("DP Calls: %llu; maximum_feasible calls: %llu, DP/feasible calls: %Lf, DP time: ", m->test_counter, m->maximum_feasible_counter, ratio);
+    timeval_print(&m->dyn_total);
+    MEASURE_PRINT("seconds.\n");
+#ifdef MEASURE
+    long double pruning = m->adv_heuristic_calls ? (long double) m->adv_heuristic_hits / (long double) m->adv_heuristic_calls : 0;
+#endif
+    MEASURE_PRINT("Adversary heuristic calls: %llu; refuted: %llu, pruning rate: %Lf, k-move cache hits: %llu.\n",
+		  m->adv_heuristic_calls, m->adv_heuristic_hits, pruning, m->kmove_cache_hits);
+    MEASURE_PRINT("Position cache hits on results of earlier evaluations: %llu.\n", s->ht.reused);
+    MEASURE_PRINT("Dominance lookups: %llu; settled as algorithm wins: %llu, as adversary wins: %llu.\n",
+		  m->dom_lookups, m->dom_hits_algorithm, m->dom_hits_adversary);
+    MEASURE_PRINT("Proof-number search expansions: %llu.\n", m->pn_expansions);
+    MEASURE_PRINT("Tablebase hits won by the adversary: %llu.\n", m->tb_hits);
+    MEASURE_PRINT("Cached vertices of the output expanded by the refuting item: %llu, by a search: %llu.\n",
+		  m->cached_by_item, m->cached_by_search);
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: ./lb [--memory SIZE] [--hugepages none|thp|2M|1G] [--numa none|local|interleave] [--certificate FILE] [--minimize]\n");
+    fprintf(stderr, "            [--engine dfs|pn|retro] [--coarse STEP] [--threshold]\n");
+    fprintf(stderr, "            [--tablebase FILE | --tablebase-generate FILE VOLUME]\n");
+    fprintf(stderr, "            [--coordinator ADDRESS [--split-depth D] [--local-workers N] | --worker ADDRESS]\n");
+    fprintf(stderr, "            [--daemon ADDRESS | --batch FILE [--jobs J]]\n");
+    fprintf(stderr, "ADDRESS is unix:/path/to/socket or tcp:host:port.\n");
+    fprintf(stderr, "SIZE is the memory budget per process, in MB or with a K, M or G suffix.\n");
+    fprintf(stderr, "FILE receives the lower bound as a binary certificate (see data/README).\n");
+    fprintf(stderr, "--minimize makes the lower bound smaller before it is output.\n");
+    fprintf(stderr, "--engine chooses the search: dfs is the minimax (default), pn the proof-number search,\n");
+    fprintf(stderr, "         retro the retrograde analysis of all reachable configurations.\n");
+    fprintf(stderr, "--tablebase-generate solves all configurations with at most VOLUME left and writes them to FILE,\n");
+    fprintf(stderr, "         which --tablebase reads for the search.\n");
+    fprintf(stderr, "--threshold finds the largest R' <= R for which R'/S is a lower bound, without the game tree.\n");
+    fprintf(stderr, "--daemon serves evaluations of configurations on ADDRESS, keeping the caches warm (see daemon.h).\n");
+    fprintf(stderr, "--batch evaluates the configurations in FILE (- for the standard input), one per line,\n");
+    fprintf(stderr, "         by J threads with warm caches (see batch.h).\n");
+    fprintf(stderr, "--coarse first lets the adversary send only multiples of STEP, then of STEP/2, ..., down to 1.\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *coordinator = NULL, *worker = NULL, *certificate = NULL, *daemon_addr = NULL;
+    const char *batch = NULL;
+    const char *tablebase = NULL, *tablebase_output = NULL;
+    int split_depth = 1, local_workers = 0, coarse = 1, tablebase_volume = 0, jobs = 1;
+    bool minimize = false, threshold = false;
+    llu budget = 0;
+
+    for(int i=1; i<argc; i++)
+    {
+	if(strcmp(argv[i], "--coordinator") == 0 && i+1 < argc)
+	{
+	    coordinator = argv[++i];
+	} else if(strcmp(argv[i], "--worker") == 0 && i+1 < argc)
+	{
+	    worker = argv[++i];
+	} else if(strcmp(argv[i], "--daemon") == 0 && i+1 < argc)
+	{
+	    daemon_addr = argv[++i];
+	} else if(strcmp(argv[i], "--batch") == 0 && i+1 < argc)
+	{
+	    batch = argv[++i];
+	} else if(strcmp(argv[i], "--jobs") == 0 && i+1 < argc)
+	{
+	    jobs = atoi(argv[++i]);
+	    if(jobs < 1)
+	    {
+		usage();
+		return -1;
+	    }
+	} else if(strcmp(argv[i], "--split-depth") == 0 && i+1 < argc)
+	{
+	    split_depth = atoi(argv[++i]);
+	} else if(strcmp(argv[i], "--local-workers") == 0 && i+1 < argc)
+	{
+	    local_workers = atoi(argv[++i]);
+	} else if(strcmp(argv[i], "--certificate") == 0 && i+1 < argc)
+	{
+	    certificate = argv[++i];
+	} else if(strcmp(argv[i], "--minimize") == 0)
+	{
+	    minimize = true;
+	} else if(strcmp(argv[i], "--threshold") == 0)
+	{
+	    threshold = true;
+	} else if(strcmp(argv[i], "--tablebase") == 0 && i+1 < argc)
+	{
+	    tablebase = argv[++i];
+	} else if(strcmp(argv[i], "--tablebase-generate") == 0 && i+2 < argc)
+	{
+	    tablebase_output = argv[++i];
+	    tablebase_volume = atoi(argv[++i]);
+	    if(tablebase_volume < 0 || tablebase_volume > BINS*S)
+	    {
+		usage();
+		return -1;
+	    }
+	} else if(strcmp(argv[i], "--coarse") == 0 && i+1 < argc)
+	{
+	    coarse = atoi(argv[++i]);
+	    if(coarse < 1 || coarse > S)
+	    {
+		usage();
+		return -1;
+	    }
+	} else if(strcmp(argv[i], "--engine") == 0 && i+1 < argc)
+	{
+	    engine = parse_engine(argv[++i]);
+	    if(engine == -1)
+	    {
+		usage();
+		return -1;
+	    }
+	} else if(strcmp(argv[i], "--hugepages") == 0 && i+1 < argc)
+	{
+	    hugepages_mode = parse_hugepages(argv[++i]);
+	    if(hugepages_mode == -1)
+	    {
+		usage();
+		return -1;
+	    }
+	} else if(strcmp(argv[i], "--numa") == 0 && i+1 < argc)
+	{
+	    numa_policy = parse_numa(argv[++i]);
+	    if(numa_policy == -1)
+	    {
+		usage();
+		return -1;
+	    }
+	} else if(strcmp(argv[i], "--memory") == 0 && i+1 < argc)
+	{
+	    budget = parse_memory(argv[++i]);
+	    if(budget == 0)
+	    {
+		usage();
+		return -1;
+	    }
+	} else {
+	    usage();
+	    return -1;
+	}
+    }
+
+    // the other modes run alone and reject the options they would ignore;
+    // the daemon and the batch search by evaluate(), with the engine and the tablebase
+    const char *mode = (tablebase_output != NULL) ? "--tablebase-generate" : (daemon_addr != NULL) ? "--daemon"
+	: (batch != NULL) ? "--batch" : threshold ? "--threshold" : NULL;
+    if(mode != NULL)
+    {
+	bool evaluates = (tablebase_output == NULL) && (daemon_addr != NULL || batch != NULL);
+	struct { const char *name; bool given; } options[] = {
+	    {"--daemon", daemon_addr != NULL}, {"--batch", batch != NULL}, {"--threshold", threshold},
+	    {"--coordinator", coordinator != NULL}, {"--worker", worker != NULL},
+	    {"--coarse", coarse > 1}, {"--minimize", minimize}, {"--certificate", certificate != NULL},
+	    {"--engine", engine != ENGINE_DFS && !evaluates}, {"--tablebase", tablebase != NULL && !evaluates}
+	};
+	for(int i=0; i < (int) (sizeof(options)/sizeof(options[0])); i++)
+	{
+	    if(options[i].given && strcmp(options[i].name, mode) != 0)
+	    {
+		fprintf(stderr, "%s does not support %s.\n", mode, options[i].name);
+		return -1;
+	    }
+	}
+    }
+
+    // the coordinator splits the full game only
+    if(coordinator != NULL && coarse > 1)
+    {
+	fprintf(stderr, "--coordinator does not support --coarse.\n");
+	return -1;
+    }
 
-    init_sparse_dynprog();
-    global_hashtable_init();
+    solver s;
+    solver_init(&s);
+
+    // the retrograde layers are global, so it evaluates one line at a time
+    if(batch != NULL && engine == ENGINE_RETRO && jobs > 1)
+    {
+	fprintf(stderr, "The retrograde engine evaluates a batch by one job.\n");
+	jobs = 1;
+    }
+
+    // local workers share the budget of the coordinator, batch jobs each other's
+    if(budget > 0 && coordinator != NULL)
+    {
+	budget /= (local_workers + 1);
+    }
+    if(budget > 0 && batch != NULL)
+    {
+	budget /= jobs;
+    }
+    if(budget > 0 && !memory_plan(&s, budget, threshold))
+    {
+	return -1;
+    }
+
+    zobrist_init();
+    solver_alloc(&s);
+    if(engine == ENGINE_PN)
+    {
+	pn_init(&s);
+    }
+#ifdef MEASURE
+    tlb_measure_start();
+#endif
+
+    if(tablebase_output != NULL)
+    {
+	bool ok = tablebase_generate(&s, tablebase_output, tablebase_volume);
+	tablebase_free();
+	solver_free(&s);
+	zobrist_free();
+	return ok ? 0 : -1;
+    }
+    if(tablebase != NULL && !tablebase_read(tablebase))
+    {
+	solver_free(&s);
+	zobrist_free();
+	return -1;
+    }
+
+    if(daemon_addr != NULL)
+    {
+	int ret = daemon_main(&s, daemon_addr);
+	measure_print(&s);
+	solver_free(&s);
+	pn_cleanup(&s);
+	retro_free();
+	tablebase_free();
+	zobrist_free();
+	return ret;
+    }
+
+    if(batch != NULL)
+    {
+	long long lines = batch_main(&s, batch, jobs);
+	if(lines >= 0)
+	{
+	    fprintf(stderr, "Batch: %lld lines evaluated by %d jobs.\n", lines, jobs);
+	}
+	measure_print(&s);
+	solver_free(&s);
+	pn_cleanup(&s);
+	retro_free();
+	tablebase_free();
+	zobrist_free();
+	return lines >= 0 ? 0 : -1;
+    }
+
+    if(threshold)
+    {
+	binconf root;
+	init(&root);
+	hashinit(&root);
+	threshold_init(&s);
+	int best = threshold_search(&s, &root);
+	if(best > S)
+	{
+	    fprintf(stderr, "%d/%d Bin Stretching on %d bins has a lower bound.\n", best, S, BINS);
+	    if(best < R)
+	    {
+		fprintf(stderr, "%d/%d Bin Stretching on %d bins can be won by Algorithm.\n", best+1, S, BINS);
+	    }
+	} else {
+	    fprintf(stderr, "%d/%d Bin Stretching on %d bins can be won by Algorithm.\n", S+1, S, BINS);
+	}
+	MEASURE_PRINT("Threshold search vertices: %llu.\n", s.measure.th_vertices);
+#ifndef MEASURE
+	if(budget > 0)
+#endif
+	{
+	    memory_report(&s);
+	    alloc_report();
+	}
+	threshold_cleanup(&s);
+	solver_free(&s);
+	pn_cleanup(&s);
+	tablebase_free();
+	zobrist_free();
+	return 0;
+    }
+
+    if(worker != NULL)
+    {
+	int ret = worker_main(&s, worker);
+	solver_free(&s);
+	pn_cleanup(&s);
+	zobrist_free();
+	return ret;
+    }
     
     binconf a;
     gametree *t;
+    int ret;
     
     init(&a); // init game tree
 
-    int ret = evaluate(&a,&t,0);
+    if(coordinator != NULL)
+    {
+	ret = coordinator_main(&s, coordinator, split_depth, local_workers);
+	if(ret == -1)
+	{
+	    return -1;
+	}
+#ifdef OUTPUT
+	fprintf(stderr, "The distributed search does not output the game tree.\n");
+#endif
+    } else if(coarse > 1)
+    {
+	ret = coarse_evaluate(&s, &a, &t, 0, coarse);
+    } else {
+	ret = evaluate(&s, &a,&t,0);
+    }
+
     if(ret == 0)
     {
 	fprintf(stderr, "%d/%d Bin Stretching on %d bins has a lower bound.\n", R,S,BINS);
+	if(minimize)
+	{
+	    if(coordinator != NULL)
+	    {
+		fprintf(stderr, "The distributed search does not minimize the lower bound.\n");
+	    } else {
+		t = minimize_gametree(&s, t);
+	    }
+	}
 #ifdef OUTPUT
-	printf("strict digraph %d%d {\n", R, S);
-	printf("overlap = none;\n");
-	print_gametree(t);
-	printf("}\n");
+	if(coordinator == NULL)
+	{
+	    printf("strict digraph %d%d {\n", R, S);
+	    printf("overlap = none;\n");
+	    print_gametree(&s, stdout, t);
+	    printf("}\n");
+	}
 #endif
+	if(certificate != NULL)
+	{
+	    if(coordinator != NULL)
+	    {
+		fprintf(stderr, "The distributed search does not output a certificate.\n");
+	    } else if(!cert_write(&s, certificate, t))
+	    {
+		solver_free(&s);
+		pn_cleanup(&s);
+		zobrist_free();
+		return -1;
+	    }
+	}
     } else {
 	fprintf(stderr, "%d/%d Bin Stretching on %d bins can be won by Algorithm.\n", R,S,BINS);
     }
+    measure_print(&s);
+
+#ifndef MEASURE
+    if(budget > 0)
+#endif
+    {
+	memory_report(&s);
+	alloc_report();
+    }
 #ifdef MEASURE
-    long double ratio = (long double) test_counter / (long double) maximum_feasible_counter;   
+    long long tlb_misses = tlb_measure_read();
+    if(tlb_misses >= 0)
+    {
+	MEASURE_PRINT("Data TLB load misses: %lld.\n", tlb_misses);
+    } else {
+	MEASURE_PRINT("Data TLB load misses: not available.\n");
+    }
 #endif
-    MEASURE_PRINT("DP Calls: %llu; maximum_feasible calls: %llu, DP/feasible calls: %Lf, DP time: ", test_counter, maximum_feasible_counter, ratio);
-    timeval_print(&dynTotal);
-    MEASURE_PRINT("seconds.\n");
 
-    free_sparse_dynprog();
-    global_hashtable_cleanup();
+    solver_free(&s);
+    pn_cleanup(&s);
+    retro_free();
+    tablebase_free();
+    zobrist_free();
     return 0;
 }
@@ -3,6 +3,13 @@
 #include <assert.h>
 #include <math.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
 // functions for measuring elapsed time
 // code origin: http://stackoverflow.com/questions/1468596/calculating-elapsed-time-in-a-c-program-in-milliseconds
@@ -10,18 +17,60 @@
 #ifndef _MEASURE_H
 #define _MEASURE_H 1
 
-// Global variable measuring total time spent on dynamic programming.
-struct timeval dynTotal;
+// Counters of one solver (see solver.h), printed when MEASURE is defined.
+struct measure_counters {
+    // total time spent on dynamic programming
+    struct timeval dyn_total;
+
+    // # of dyn. programming runs
+    unsigned long long int test_counter;
+    unsigned long long int maximum_feasible_counter;
+
+    // success of the adversary heuristic
+    unsigned long long int adv_heuristic_calls;
+    unsigned long long int adv_heuristic_hits;
+    unsigned long long int kmove_cache_hits;
+
+    // how often the dominance index settles a configuration
+    unsigned long long int dom_lookups;
+    unsigned long long int dom_hits_algorithm;
+    unsigned long long int dom_hits_adversary;
+
+    // adversary vertices expanded by the proof-number search
+    unsigned long long int pn_expansions;
+
+    // configurations won by the adversary found in the tablebase
+    unsigned long long int tb_hits;
+
+    // adversary vertices of the threshold search
+    unsigned long long int th_vertices;
+
+    // cached vertices of the output expanded by their refuting item, and by a search
+    unsigned long long int cached_by_item;
+    unsigned long long int cached_by_search;
+};
+
+typedef struct measure_counters measure_counters;
 
-// Global variable measuring # of dyn. programming runs
-unsigned long long int test_counter = 0;
-unsigned long long int maximum_feasible_counter = 0;
+void timeval_add(struct timeval *result, const struct timeval *t);
 
-// Run at the start of the program to ensure measurement initialization.
-void measure_init()
+// Adds the counters of another solver, e.g. of a batch thread.
+void measure_add(measure_counters *to, const measure_counters *from)
 {
-    dynTotal.tv_sec = 0;
-    dynTotal.tv_usec = 0;
+    timeval_add(&to->dyn_total, &from->dyn_total);
+    to->test_counter += from->test_counter;
+    to->maximum_feasible_counter += from->maximum_feasible_counter;
+    to->adv_heuristic_calls += from->adv_heuristic_calls;
+    to->adv_heuristic_hits += from->adv_heuristic_hits;
+    to->kmove_cache_hits += from->kmove_cache_hits;
+    to->dom_lookups += from->dom_lookups;
+    to->dom_hits_algorithm += from->dom_hits_algorithm;
+    to->dom_hits_adversary += from->dom_hits_adversary;
+    to->pn_expansions += from->pn_expansions;
+    to->tb_hits += from->tb_hits;
+    to->th_vertices += from->th_vertices;
+    to->cached_by_item += from->cached_by_item;
+    to->cached_by_search += from->cached_by_search;
 }
 
 /* Return 1 if the difference is negative, otherwise 0.  */
@@ -48,4 +97,40 @@ void timeval_print(const struct timeval *t)
     MEASURE_PRINT("%ld.%06ld", t->tv_sec, t->tv_usec);
 
 }
+// Counting data TLB misses with a hardware performance counter, if the system allows it.
+int tlb_counter_fd = -1;
+
+void tlb_measure_start()
+{
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    tlb_counter_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if(tlb_counter_fd >= 0)
+    {
+	ioctl(tlb_counter_fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(tlb_counter_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+// Returns the number of data TLB load misses since tlb_measure_start(), or -1 if not available.
+long long tlb_measure_read()
+{
+    long long count = -1;
+#ifdef __linux__
+    if(tlb_counter_fd >= 0 && read(tlb_counter_fd, &count, sizeof(count)) != sizeof(count))
+    {
+	count = -1;
+    }
+#endif
+    return count;
+}
+
 #endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "hash.h"
+#include "dynprog.h"
+#include "minimax.h"
+#include "pn.h"
+#include "threshold.h"
+
+// Memory budget governor: sizes the hash tables at startup so that
+// all large structures fit into a given budget.
+
+#ifndef _MEMORY_H
+#define _MEMORY_H 1
+
+// estimated overhead of a single malloc() call
+#define MALLOC_OVERHEAD 16
+
+// memory budget in bytes, 0 if there is none
+llu memory_budget = 0;
+
+// Parses a memory size such as "4096", "512M" or "16G"; the default unit is MB.
+// Returns 0 on failure.
+llu parse_memory(const char *str)
+{
+    char *end;
+    llu value = strtoull(str, &end, 10);
+    switch(toupper(*end))
+    {
+    case 'K': value <<= 10; end++; break;
+    case 'G': value <<= 30; end++; break;
+    case 'M': end++; // fall through
+    case '\0': value <<= 20; break;
+    default: return 0;
+    }
+    if(*end != '\0' && toupper(*end) != 'B')
+    {
+	return 0;
+    }
+    return value;
+}
+
+llu zobrist_memory()
+{
+    return (BINS+1)*sizeof(llu *) + BINS*(R+1)*sizeof(llu)
+	+ (S+1)*sizeof(llu *) + S*(R+1)*BINS*sizeof(llu);
+}
+
+// worst-case memory of a hash table with all chains full; the buckets
+// may take whole huge pages
+llu table_memory(llu size, int chainlen, size_t entry)
+{
+    return large_alloc_footprint(size*sizeof(void *)) + size*chainlen*(entry + MALLOC_OVERHEAD);
+}
+
+// Chooses the number of buckets and the chain length of a table so that
+// it fits into share bytes even when it is full. Prefers more buckets
+// as long as chains of length two fit; returns false if even the smallest
+// table does not fit.
+bool size_table(llu share, size_t entry, llu *size, int *chainlen)
+{
+    int minchain = (CHAINLEN < 2) ? CHAINLEN : 2;
+    for(int log = HASHLOG_MAX; log >= HASHLOG_MIN; log--)
+    {
+	llu buckets = 1ULL << log;
+	for(int chain = CHAINLEN; chain >= minchain; chain--)
+	{
+	    if(table_memory(buckets, chain, entry) <= share)
+	    {
+		*size = buckets;
+		*chainlen = chain;
+		return true;
+	    }
+	}
+    }
+
+    // the budget is tight; evict on every collision
+    *size = 1ULL << HASHLOG_MIN;
+    *chainlen = 1;
+    return table_memory(*size, 1, entry) <= share;
+}
+
+// Chooses the number of entries of a direct-mapped table, a power of two,
+// so that it fits into share bytes; returns false if even the smallest does not.
+bool size_direct(llu share, size_t entry, llu *size)
+{
+    for(int log = HASHLOG_MAX; log >= HASHLOG_MIN; log--)
+    {
+	if(large_alloc_footprint((1ULL << log) * entry) <= share)
+	{
+	    *size = 1ULL << log;
+	    return true;
+	}
+    }
+    *size = 1ULL << HASHLOG_MIN;
+    return false;
+}
+
+/* Sizes the tables of solver s from the budget and the instance.
+ * Has to be called before solver_alloc(); threshold tells whether the table
+ * of the threshold search is needed. Returns false if the budget cannot hold the dynamic programming arrays.
+ */
+bool memory_plan(solver *s, llu budget, bool threshold)
+{
+    memory_budget = budget;
+    llu fixed = dp_memory() + zobrist_memory() + KMOVE_CACHESIZE*sizeof(kmove_cache_item);
+    if(budget <= fixed)
+    {
+	fprintf(stderr, "The memory budget of %llu MB cannot hold the dynamic programming arrays (%llu MB).\n",
+		budget >> 20, fixed >> 20);
+	return false;
+    }
+
+    // the output table (outht) is exact and grows with the tree being output,
+    // which takes more memory itself; it is not part of the budget
+    llu rest = budget - fixed;
+    bool fits = true;
+    if(engine == ENGINE_PN)
+    {
+	// the proof and disproof numbers get a quarter
+	fits &= size_direct(rest/4, sizeof(pn_entry), &s->pnsize);
+	rest -= large_alloc_footprint(s->pnsize * sizeof(pn_entry));
+    }
+    if(threshold)
+    {
+	// the threshold search caches its bounds in thht only, the rest
+	// serves the dynamic programming
+	fits &= size_direct(rest/2, sizeof(th_entry), &s->thsize);
+	rest -= large_alloc_footprint(s->thsize * sizeof(th_entry));
+    }
+    llu htshare = 2*(rest/3);
+    fits &= size_table(rest/3, sizeof(dp_hash_item), &s->dpht.size, &s->dpht.chainlen);
+#ifdef DOMINANCE
+    // a quarter of the position cache share goes to the dominance index
+    fits &= size_table(htshare/4, sizeof(binconf), &s->domht.size, &s->domht.chainlen);
+    htshare -= htshare/4;
+#endif
+    fits &= size_table(htshare, sizeof(binconf), &s->ht.size, &s->ht.chainlen);
+    if(!fits)
+    {
+	fprintf(stderr, "Warning: the memory budget is too small even for the smallest hash tables.\n");
+    }
+
+    fprintf(stderr, "Memory budget %llu MB: ht %llu x %d, domht %llu x %d, dpht %llu x %d (buckets x chain).\n",
+	    budget >> 20, s->ht.size, s->ht.chainlen, s->domht.size, s->domht.chainlen, s->dpht.size, s->dpht.chainlen);
+    if(engine == ENGINE_PN)
+    {
+	fprintf(stderr, "Memory budget: pnht %llu entries.\n", s->pnsize);
+    }
+    if(threshold)
+    {
+	fprintf(stderr, "Memory budget: thht %llu entries.\n", s->thsize);
+    }
+    return true;
+}
+
+void memory_report_table(const char *name, llu size, int chainlen, llu peak, size_t entry)
+{
+    fprintf(stderr, "%s: %llu buckets, chains of at most %d, peak %llu entries, %.1f MB.\n", name, size, chainlen, peak,
+	    (double) (size*sizeof(void *) + peak*(entry + MALLOC_OVERHEAD)) / (1 << 20));
+}
+
+// Reports the peak memory usage of each large structure.
+void memory_report(solver *s)
+{
+    struct rusage usage;
+    memory_report_table("ht", s->ht.size, s->ht.chainlen, s->ht.peak, sizeof(binconf));
+#ifdef DOMINANCE
+    memory_report_table("domht", s->domht.size, s->domht.chainlen, s->domht.peak, sizeof(binconf));
+#endif
+    memory_report_table("dpht", s->dpht.size, s->dpht.chainlen, s->dpht.peak, sizeof(dp_hash_item));
+    if(engine == ENGINE_PN)
+    {
+	fprintf(stderr, "pnht: %llu entries, %.1f MB.\n", s->pnsize,
+		(double) large_alloc_footprint(s->pnsize*sizeof(pn_entry)) / (1 << 20));
+    }
+    if(s->thht != NULL)
+    {
+	fprintf(stderr, "thht: %llu entries, %.1f MB.\n", s->thsize,
+		(double) large_alloc_footprint(s->thsize*sizeof(th_entry)) / (1 << 20));
+    }
+    fprintf(stderr, "outht: %llu slots, peak %llu entries, %.1f MB.\n", s->outht.size, s->outht.peak,
+	    (double) (s->outht.size*sizeof(conf_map_entry)) / (1 << 20));
+    fprintf(stderr, "DP arrays: %.1f MB.\n", (double) dp_memory() / (1 << 20));
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "Peak resident set size: %.1f MB", (double) usage.ru_maxrss / 1024);
+    if(memory_budget > 0)
+    {
+	fprintf(stderr, " (budget %llu MB)", memory_budget >> 20);
+    }
+    fprintf(stderr, ".\n");
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "common.h"
 #include "hash.h"
@@ -9,114 +10,242 @@
 #include "dynprog.h"
 #include "measure.h"
 #include "gs.h"
+#include "dominance.h"
+#include "tablebase.h"
+#include "solver.h"
 
 // Minimax routines.
 #ifndef _MINIMAX_H
 #define _MINIMAX_H 1
 
 /* declarations */
-int adversary(const binconf *b, int depth, gametree *prev_vertex, char prev_bin); 
-int algorithm(const binconf *b, int k, int depth, gametree *cur_vertex);
+int adversary(solver *s, const binconf *b, int depth, gametree *prev_vertex, char prev_bin);
+int algorithm(solver *s, const binconf *b, int k, int depth, gametree *cur_vertex);
+int evaluate(solver *s, binconf *b, gametree **rettree, int depth);
 
 /* declaring which algorithm will be used */
 #define ALGORITHM algorithm
 #define ADVERSARY adversary
-#define DOUBLE_MOVE double_move
-#define TRIPLE_MOVE triple_move
+#define K_MOVE k_move
 #define MAXIMUM_FEASIBLE maximum_feasible_dynprog
 
-/* tries a double move given in a[0],a[1].
- * returns 1 if it possible to pack the two items -- does not go deeper
- * returns 0 if it is not possible to do so.
+#define ENGINE_DFS 0
+#define ENGINE_PN 1
+#define ENGINE_RETRO 2
+
+// the search engine of evaluate(), chosen by --engine
+int engine = ENGINE_DFS;
+
+int parse_engine(const char *str)
+{
+    if(strcmp(str, "dfs") == 0)
+	return ENGINE_DFS;
+    if(strcmp(str, "pn") == 0)
+	return ENGINE_PN;
+    if(strcmp(str, "retro") == 0)
+	return ENGINE_RETRO;
+    return -1;
+}
+
+/* A direct-mapped cache of k_move() results, indexed by the loads
+ * and the items of the move. An empty slot has k == 0.
  */
-int double_move(const binconf *b, const int *a)
+struct kmove_cache_item {
+    char loads[BINS+1];
+    char items[ADV_HEURISTIC_K];
+    char k;
+    char result;
+};
+
+typedef struct kmove_cache_item kmove_cache_item;
+
+// Allocates the tables of solver s, whose sizes are set by solver_init() and memory_plan().
+void solver_alloc(solver *s)
 {
-    DEBUG_PRINT("Attempting double move (%d,%d) on binconf:\n", a[0],a[1]);
-    DEBUG_PRINT_BINCONF(b);
-    
-    binconf *d;
-    d = malloc(sizeof(binconf));
-    duplicate(d,b);
-    for(int i =1; i<=3; i++) // first item
+    dp_hashtable_alloc(&s->dpht);
+    conf_map_init(&s->outht);
+    conf_hashtable_alloc(&s->ht);
+#ifdef DOMINANCE
+    conf_hashtable_alloc(&s->domht);
+#endif
+    init_sparse_dynprog(s);
+    s->kmove_cache = calloc(KMOVE_CACHESIZE, sizeof(kmove_cache_item));
+    assert(s->kmove_cache != NULL);
+}
+
+void solver_free(solver *s)
+{
+    conf_map_free(&s->outht);
+    conf_hashtable_free(&s->ht);
+#ifdef DOMINANCE
+    conf_hashtable_free(&s->domht);
+#endif
+    dp_hashtable_free(&s->dpht);
+    free_sparse_dynprog(s);
+    free(s->kmove_cache);
+    s->kmove_cache = NULL;
+}
+
+/* returns 1 if items a[0],...,a[k-1] can be packed into the bins with loads
+ * without any bin reaching R, 0 otherwise. Restores loads before returning.
+ */
+int kfit(char *loads, const int *a, int k)
+{
+    if(k == 0)
+    {
+	return 1;
+    }
+
+    for(int i=1; i<=BINS; i++)
     {
-	if((d->loads[i] + a[0] < R))
+	if(loads[i] + a[0] >= R)
+	    continue;
+
+	// bins with equal loads are symmetric, try only the first of them
+	bool symmetric = false;
+	for(int j=1; j<i; j++)
 	{
-	    d->loads[i] += a[0];
-	    d->items[a[0]]++;
-	    for(int j=1; j<=3; j++) // second item
+	    if(loads[j] == loads[i])
 	    {
-		if((d->loads[j] + a[1] < R))
-		{
-		    DEBUG_PRINT("double move can be packed, ending heuristic.\n");
-		    free(d);
-		    return 1;
-		}
+		symmetric = true;
+		break;
 	    }
-	    d->loads[i] -= a[0];
-	    d->items[a[0]]--;
 	}
-    }
-    DEBUG_PRINT("Move (%d,%d) cannot be packed, double_move success.\n",a[0],a[1]);
+	if(symmetric)
+	    continue;
 
-    free(d);
+	loads[i] += a[0];
+	int r = kfit(loads, a+1, k-1);
+	loads[i] -= a[0];
+	if(r == 1)
+	{
+	    return 1;
+	}
+    }
     return 0;
-   
 }
 
-/* tries a triple-move given in a[0],a[1],a[2]
- * returns 1 if it is possible to pack the three items -- does not investigate futher!
- * returns 0 if it is not possible to pack the triple-move
- * suggestion: it can cache zero results, but it currently does not.
+/* tries a k-move given in a[0],...,a[k-1] (generalizes the former double and triple moves)
+ * returns 1 if it is possible to pack the k items -- does not go deeper
+ * returns 0 if it is not possible to do so.
  */
-int triple_move(const binconf *b, const int *a)
+int k_move(solver *s, const binconf *b, const int *a, int k)
 {
-    DEBUG_PRINT("Attempting triple move (%d,%d,%d) on binconf:\n", a[0],a[1],a[2]);
+    DEBUG_PRINT("Attempting a %d-move starting with %d on binconf:\n", k, a[0]);
     DEBUG_PRINT_BINCONF(b);
- 
-    binconf *d;
-    d = malloc(sizeof(binconf));
-    duplicate(d,b);
-    for(int i =1; i<=3; i++) // first item
+
+    assert(k <= ADV_HEURISTIC_K);
+    llu hash = b->loadhash;
+    for(int i=0; i<k; i++)
+    {
+	hash ^= Zi[a[i]][i+1];
+    }
+    kmove_cache_item *slot = &s->kmove_cache[hash & (KMOVE_CACHESIZE-1)];
+
+    bool match = (slot->k == k);
+    for(int i=1; match && i<=BINS; i++)
+    {
+	match = (slot->loads[i] == b->loads[i]);
+    }
+    for(int i=0; match && i<k; i++)
     {
-	if((d->loads[i] + a[0] < R))
+	match = (slot->items[i] == a[i]);
+    }
+
+    if(match)
+    {
+#ifdef MEASURE
+	s->measure.kmove_cache_hits++;
+#endif
+	return slot->result;
+    }
+
+    char loads[BINS+1];
+    for(int i=1; i<=BINS; i++)
+    {
+	loads[i] = b->loads[i];
+    }
+
+    int r = kfit(loads, a, k);
+    DEBUG_PRINT("The %d-move can%s be packed.\n", k, r ? "" : "not");
+
+    for(int i=1; i<=BINS; i++)
+    {
+	slot->loads[i] = b->loads[i];
+    }
+    for(int i=0; i<k; i++)
+    {
+	slot->items[i] = a[i];
+    }
+    slot->k = k;
+    slot->result = r;
+    return r;
+}
+
+/* Fast refutation of a configuration: for k = 2, ..., ADV_HEURISTIC_K,
+ * takes the k largest items the offline optimum can still accept and
+ * checks whether the algorithm can pack them.
+ * Returns the number of items of a successful move (stored into a),
+ * or 0 if no refutation is found.
+ */
+int adversary_heuristic(solver *s, const binconf *b, int *a)
+{
+#ifdef MEASURE
+    s->measure.adv_heuristic_calls++;
+#endif
+    for(int k=2; k<=ADV_HEURISTIC_K; k++)
+    {
+	if((maxk(b, a, k, false) == 1 && K_MOVE(s, b, a, k) == 0)
+	   || (maxk(b, a, k, true) == 1 && K_MOVE(s, b, a, k) == 0))
 	{
-	    d->loads[i] += a[0];
-	    d->items[a[0]]++;
-	    for(int j=1; j<=3; j++) // second item
-	    {
-		if((d->loads[j] + a[1] < R))
-		{
-		    d->loads[j] += a[1];
-		    d->items[a[1]]++;
-		    for(int k=1; k<=3; k++) // third item
-		    {
-			if((d->loads[k] + a[2] < R))
-			{
-			    DEBUG_PRINT("triple move can be packed, ending heuristic.\n");
-			    free(d);
-			    return 1;
-			}
-		    }
-		    d->loads[j] -= a[1];
-		    d->items[a[1]]--;
-		}
-	    }
-	    d->loads[i] -= a[0];
-	    d->items[a[0]]--;
+#ifdef MEASURE
+	    s->measure.adv_heuristic_hits++;
+#endif
+	    return k;
 	}
     }
-    free(d);
-    DEBUG_PRINT("triple move (%d,%d,%d) cannot be packed, triple_move success.\n",a[0],a[1],a[2]);
     return 0;
 }
 
+/* Builds the game tree of a successful k-move a[0],...,a[k-1] sent
+ * from configuration b, so that the output stays verifiable.
+ */
+void heuristic_gametree(solver *s, const binconf *b, const int *a, int k, gametree *prev_vertex, char prev_bin)
+{
+    gametree *new_vertex, *leaf_vertex;
+    binconf d;
+
+    assert(k > 0);
+    new_vertex = malloc(sizeof(gametree));
+    init_gametree_vertex(s, new_vertex, b, a[0], prev_vertex->depth + 1);
+    prev_vertex->next[prev_bin] = new_vertex;
+
+    for(int i=1; i<=BINS; i++)
+    {
+	if(b->loads[i] + a[0] < R)
+	{
+	    duplicate(&d, b);
+	    d.loads[i] += a[0];
+	    d.items[a[0]]++;
+	    sortloads(&d);
+	    rehash(&d, b, a[0]);
+	    heuristic_gametree(s, &d, a+1, k-1, new_vertex, i);
+	} else {
+	    leaf_vertex = malloc(sizeof(gametree));
+	    init_gametree_vertex(s, leaf_vertex, b, 0, new_vertex->depth + 1);
+	    leaf_vertex->leaf = 1;
+	    new_vertex->next[i] = leaf_vertex;
+	}
+    }
+}
+
 /* return values: 0: player 1 cannot pack the sequence starting with binconf b
  * 1: player 1 can pack all possible sequences starting with b
  */
 
 // depth: how deep in the game tree the given situation is
 
-int adversary(const binconf *b, int depth, gametree *prev_vertex, char prev_bin) {
+int adversary(solver *s, const binconf *b, int depth, gametree *prev_vertex, char prev_bin) {
 #ifdef PROGRESS
     if(depth <= 2)
     {
@@ -125,50 +254,49 @@ int adversary(const binconf *b, int depth, gametree *prev_vertex, char prev_bin)
 	fprintf(stderr, "\n");
     }
 #endif
-    // try double move and triple move first
-    int *res;
+    if(s->abort_check != NULL && ((++s->abort_counter) & 0xfff) == 0)
+    {
+	s->abort_check(s);
+    }
+    if(s->search_aborted)
+    {
+	return 1;
+    }
+
+    int res[BINS+ADV_HEURISTIC_K];
     gametree *new_vertex;
-    res = malloc(BINS*sizeof(int));
     int valid;
 
-
-
-    // we currently do not use double_move and triple_move
-    /*
-    int semires = -1;
-    valid = maxtwo(b,res);
-    if(valid != 0 && DOUBLE_MOVE(b,res) == 0)
+    if ((b->loads[BINS] + (BINS*S - totalload(b))) < R)
     {
-	new_vertex = malloc(sizeof(gametree));
-	init_gametree_vertex(new_vertex, b, 0, (prev_vertex->depth)+1);
-	new_vertex->leaf = 1;
-	prev_vertex->next[prev_bin] = new_vertex;
-
-	semires = 0;
-	free(res);
-	return 0;
+	return 1;
     }
-    
-    valid = maxthree(b,res);
-    if(valid != 0 && TRIPLE_MOVE(b,res) == 0)
+
+    // the tablebase knows the result of the endgame, and the winning item
+    int tb = tablebase_probe(s, b);
+    if(tb == 0)
+    {
+	return 1;
+    } else if(tb > 0)
     {
 	new_vertex = malloc(sizeof(gametree));
-	init_gametree_vertex(new_vertex, b, 0, (prev_vertex->depth)+1);
-	new_vertex->leaf = 1;
+	init_gametree_vertex(s, new_vertex, b, tb, prev_vertex->depth + 1);
 	prev_vertex->next[prev_bin] = new_vertex;
-
-	semires = 0;
-	free(res);
-	return 0;
+	int r = ALGORITHM(s, b, tb, depth+1, new_vertex);
+	// the tablebase is right, unless the search was cancelled below
+	assert(r == 0 || s->search_aborted);
+	return r;
     }
 
-    */
-    
-    if ((b->loads[BINS] + (BINS*S - totalload(b))) < R)
+#ifdef ADV_HEURISTIC
+    // try to refute the configuration by a short sequence of large items first
+    int k = adversary_heuristic(s, b, res);
+    if(k > 0)
     {
-	free(res);
-	return 1;
+	heuristic_gametree(s, b, res, k, prev_vertex, prev_bin);
+	return 0;
     }
+#endif
     
 #ifdef MEASURE
     //MEASURE_PRINT("Entering player zero vertex.\n");
@@ -176,28 +304,29 @@ int adversary(const binconf *b, int depth, gametree *prev_vertex, char prev_bin)
     gettimeofday(&tStart, NULL); // start measuring time in order to measure dyn. prog. time
 #endif
    
-    MAXIMUM_FEASIBLE(b,res); valid = 1; // finds the maximum feasible item that can be added using dyn. prog.
+    MAXIMUM_FEASIBLE(s, b, res); valid = 1; // finds the maximum feasible item that can be added using dyn. prog.
 
 #ifdef MEASURE
     gettimeofday(&tEnd, NULL);
     timeval_subtract(&dynDiff, &tEnd, &tStart);
-    timeval_add(&dynTotal, &dynDiff); // add time spent in dyn. prog. to a global counter
+    timeval_add(&s->measure.dyn_total, &dynDiff); // add time spent in dyn. prog. to the counter of the solver
 #endif
 
     int maximum_feasible = res[0];
-    free(res);
     int r = 1;
 
     //DEBUG_PRINT("Trying player zero choices, with maxload starting at %d\n", maxload);
 
     for (int item_size = maximum_feasible; item_size>0; item_size--)
     {
+	if(item_size % s->item_step != 0)
+	    continue;
 	DEBUG_PRINT("Sending item %d to algorithm.\n", item_size);
 	new_vertex = malloc(sizeof(gametree));
-	init_gametree_vertex(new_vertex, b, item_size, prev_vertex->depth + 1);
+	init_gametree_vertex(s, new_vertex, b, item_size, prev_vertex->depth + 1);
 	prev_vertex->next[prev_bin] = new_vertex;
 
-	r = ALGORITHM(b, item_size, depth+1, new_vertex);
+	r = ALGORITHM(s, b, item_size, depth+1, new_vertex);
 	DEBUG_PRINT("With item %d, algorithm's result is %d\n", item_size, r);
 	if(r == 0)
 	    break;
@@ -210,11 +339,10 @@ int adversary(const binconf *b, int depth, gametree *prev_vertex, char prev_bin)
     return r;
 }
 
-int algorithm(const binconf *b, int k, int depth, gametree *cur_vertex) {
+int algorithm(solver *s, const binconf *b, int k, int depth, gametree *cur_vertex) {
 
     //MEASURE_PRINT("Entering player one vertex.\n");
     gametree *new_vertex;
-    binconf *e;
 
     // GS heuristics are fixed for BINS == 3, so they should not be used for more.
 #if BINS == 3
@@ -223,55 +351,133 @@ int algorithm(const binconf *b, int k, int depth, gametree *cur_vertex) {
 	return 1;
     }
 #endif
-    
-    int r = 0;
+
+    // Build all children first, so that their buckets can be prefetched together.
+    binconf d[BINS+1];
+    int order[BINS+1];
+    int children = 0;
     for(int i = 1; i<=BINS; i++)
     {
 	if((b->loads[i] + k < R))
 	{
-	    binconf *d;
-	    d = malloc(sizeof(binconf));
-	    duplicate(d, b);
-	    d->loads[i] += k;
-	    d->items[k]++;
-	    sortloads(d);
-	    rehash(d,b,k);
-	    int c = is_conf_hashed(ht,d);
-	    if ((c) != -1)
-	    {
-		//MEASURE_PRINT("Player one vertex cached.\n");
-		if(c == 0) // the vertex is good for the adversary, put it into the game tree
-		{
-		    // e = malloc(sizeof(binconf));
-		    // init(e);
-		    // duplicate(e,d);
-		    new_vertex = malloc(sizeof(gametree));
-		    init_gametree_vertex(new_vertex, d, 0, cur_vertex->depth + 1);
-		    new_vertex->cached=1;
-		    cur_vertex->next[i] = new_vertex;
-		    //new_vertex->cached_conf = e;
-		}
-		r = c;
-	    } else {
-		//MEASURE_PRINT("Player one vertex not cached.\n");	
-		r = ADVERSARY(d,depth, cur_vertex, i);
-		VERBOSE_PRINT(stderr, "We have calculated the following position, result is %d\n", r);
-		VERBOSE_PRINT_BINCONF(d);
-		conf_hashpush(ht,d,r);
-	    }
-	    free(d);
-	    if(r == 1) {
-		VERBOSE_PRINT("Winning position for algorithm, returning 1.\n");	       
-		return r;
-	    }
+	    // equal loads give the same child; the first of them represents the others
+	    if(i > 1 && b->loads[i] == b->loads[i-1])
+		continue;
+
+	    duplicate(&d[i], b);
+	    d[i].loads[i] += k;
+	    d[i].items[k]++;
+	    sortloads(&d[i]);
+	    rehash(&d[i],b,k);
+	    PREFETCH(&s->ht.t[conf_index(&s->ht, &d[i])]);
+#ifdef DOMINANCE
+	    PREFETCH(&s->domht.t[conf_index(&s->domht, &d[i])]);
+#endif
+	    order[children++] = i;
 	} else { // b->loads[i] + k >= R, so a good situation for the adversary
 	    new_vertex = malloc(sizeof(gametree));
-	    init_gametree_vertex(new_vertex, b, 0, cur_vertex->depth +1);
+	    init_gametree_vertex(s, new_vertex, b, 0, cur_vertex->depth +1);
 	    new_vertex->leaf=1;
 	    cur_vertex->next[i] = new_vertex;
 	}
     }
-    return r; 
+
+    // Probe the cache (and the dominance index): a cached win of the algorithm
+    // settles the vertex, cached wins of the adversary only need a stub in the game tree.
+    int unknown = 0;
+    for(int j = 0; j < children; j++)
+    {
+	int i = order[j];
+	int c = is_conf_hashed(&s->ht,&d[i]);
+#ifdef DOMINANCE
+	if(c == -1)
+	{
+	    c = dominance_lookup(s, &d[i]);
+	}
+#endif
+	if(c == 1)
+	{
+	    VERBOSE_PRINT("Cached winning position for algorithm, returning 1.\n");
+	    return 1;
+	} else if(c == 0) // the vertex is good for the adversary, put it into the game tree
+	{
+	    new_vertex = malloc(sizeof(gametree));
+	    init_gametree_vertex(s, new_vertex, &d[i], 0, cur_vertex->depth + 1);
+	    new_vertex->cached=1;
+	    cur_vertex->next[i] = new_vertex;
+	} else {
+	    // the children which need to be searched keep the Best Fit order
+	    order[unknown++] = i;
+	}
+    }
+
+    int r = 0;
+    for(int j = 0; j < unknown; j++)
+    {
+	int i = order[j];
+	//MEASURE_PRINT("Player one vertex not cached.\n");
+	r = ADVERSARY(s, &d[i],depth, cur_vertex, i);
+	VERBOSE_PRINT("We have calculated the following position, result is %d\n", r);
+	VERBOSE_PRINT_BINCONF(&d[i]);
+	if(!s->search_aborted && (r == 0 || s->item_step == 1))
+	{
+	    // a win of the adversary keeps the item it is won by, for the output
+	    int refuting = (r == 0) ? cur_vertex->next[i]->nextItem : 0;
+	    conf_hashpush_refuting(&s->ht, &d[i], r, refuting);
+#ifdef DOMINANCE
+	    dominance_push(s, &d[i], r, refuting);
+#endif
+	}
+	if(r == 1) {
+	    VERBOSE_PRINT("Winning position for algorithm, returning 1.\n");
+	    return r;
+	}
+    }
+    return 0;
+}
+
+
+/* Replaces the cached vertex *vertex, a configuration won by the adversary,
+ * by its game tree. If the position cache (or the dominance index) knows the
+ * refuting item, only the item is sent and the children are looked up again,
+ * so that the tree is rebuilt by walking the cache; otherwise the
+ * configuration is searched.
+ */
+void expand_cached(solver *s, gametree **vertex)
+{
+    binconf b;
+    int depth = (*vertex)->depth;
+    init(&b);
+    duplicate(&b, (*vertex)->bc);
+    delete_gametree(*vertex);
+    *vertex = NULL;
+
+    int item = conf_refuting_item(&s->ht, &b);
+#ifdef DOMINANCE
+    if(item == 0)
+    {
+	item = dominance_refuting_item(s, &b);
+    }
+#endif
+    if(item > 0)
+    {
+	gametree *new_vertex = malloc(sizeof(gametree));
+	init_gametree_vertex(s, new_vertex, &b, item, depth);
+	if(ALGORITHM(s, &b, item, 1, new_vertex) == 0)
+	{
+#ifdef MEASURE
+	    s->measure.cached_by_item++;
+#endif
+	    *vertex = new_vertex;
+	    return;
+	}
+	delete_gametree(new_vertex);
+    }
+
+#ifdef MEASURE
+    s->measure.cached_by_search++;
+#endif
+    evaluate(s, &b, vertex, depth);
 }
 
 #endif
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "hash.h"
+#include "minimax.h"
+
+// Minimization of the lower bound before output: the game tree is turned into
+// a DAG in which every configuration appears once, and adversary vertices are
+// switched to other winning items as long as the DAG gets smaller.
+
+#ifndef _MINIMIZE_H
+#define _MINIMIZE_H 1
+
+// The strategy of the adversary at a configuration of the DAG.
+struct min_entry {
+    binconf conf;
+    int item; // the item sent, 0 if not known yet
+    int hint; // the item of the original tree
+    gametree *built; // the vertex of the output DAG, once built
+    int refs; // number of parents in the DAG (1 for the root), 0 if not in the DAG
+};
+
+typedef struct min_entry min_entry;
+
+// configurations of the DAG and their indices into min_entries; exact, as a lost
+// entry would lose the item of its configuration
+conf_map minht;
+min_entry *min_entries = NULL;
+int min_len = 0, min_cap = 0;
+// number of configurations of the DAG, kept up to date by min_ref() and min_unref()
+llu min_size = 0;
+// vertices at which other items were tried, limited by MINIMIZE_BUDGET
+llu min_explored = 0;
+
+/* Returns the entry of configuration b, adding one without an item if needed. */
+int min_entry_of(const binconf *b)
+{
+    int id = conf_map_get(&minht, b);
+    if(id != -1)
+    {
+	return id;
+    }
+    if(min_len == min_cap)
+    {
+	min_cap = (min_cap == 0) ? 1024 : 2*min_cap;
+	min_entries = realloc(min_entries, min_cap*sizeof(min_entry));
+	assert(min_entries != NULL);
+    }
+    id = min_len++;
+    duplicate(&min_entries[id].conf, b);
+    min_entries[id].item = 0;
+    min_entries[id].hint = 0;
+    min_entries[id].built = NULL;
+    min_entries[id].refs = 0;
+    conf_map_put(&minht, b, id);
+    return id;
+}
+
+/* Searches whether the adversary wins by sending item in configuration b.
+ * The game tree of the search is not needed and is thrown away.
+ */
+bool min_item_wins(solver *s, const binconf *b, int item, int depth)
+{
+    gametree *v = malloc(sizeof(gametree));
+    init_gametree_vertex(s, v, b, item, depth);
+    int r = ALGORITHM(s, b, item, depth, v);
+    delete_gametree(v);
+    return r == 0;
+}
+
+/* Computes the child configuration d of b after item goes into bin.
+ * Returns false if there is no such child: the bin overflows (a leaf)
+ * or has the load of the previous bin (the same child).
+ */
+bool min_child(binconf *d, const binconf *b, int item, int bin)
+{
+    if(b->loads[bin] + item >= R || (bin > 1 && b->loads[bin] == b->loads[bin-1]))
+	return false;
+    duplicate(d, b);
+    d->loads[bin] += item;
+    d->items[item]++;
+    sortloads(d);
+    rehash(d, b, item);
+    return true;
+}
+
+/* Lists the items the adversary may send in configuration b, in the order
+ * of adversary(): the first item of a refuting k-move, then from the largest
+ * feasible one down. Returns their number.
+ */
+int min_candidates(solver *s, const binconf *b, int *items)
+{
+    int res[BINS+ADV_HEURISTIC_K], count = 0;
+#ifdef ADV_HEURISTIC
+    if(adversary_heuristic(s, b, res) > 0)
+    {
+	items[count++] = res[0];
+    }
+#endif
+    MAXIMUM_FEASIBLE(s, b, res);
+    for(int item = res[0]; item > 0; item--)
+    {
+	if(count == 0 || item != items[0])
+	    items[count++] = item;
+    }
+    return count;
+}
+
+/* Completes the strategy below configuration b, which is won by the adversary:
+ * every configuration gets an item, the one of the original tree if there is one,
+ * otherwise the first winning item of adversary(). Returns the entry of b.
+ */
+int min_complete(solver *s, const binconf *b, int depth)
+{
+    int id = min_entry_of(b);
+    if(min_entries[id].item != 0)
+	return id;
+
+    int item = min_entries[id].hint;
+    if(item == 0)
+    {
+	int items[S+1];
+	int count = min_candidates(s, b, items);
+	for(int j = 0; j < count && item == 0; j++)
+	{
+	    if(min_item_wins(s, b, items[j], depth+1))
+		item = items[j];
+	}
+	assert(item != 0);
+    }
+    min_entries[id].item = item;
+
+    binconf d;
+    for(int i=1; i<=BINS; i++)
+    {
+	if(min_child(&d, b, item, i))
+	    min_complete(s, &d, depth+1);
+    }
+    return id;
+}
+
+/* Adds a reference to configuration b, which has an item. If b was not in
+ * the DAG, it enters it and references the children of its item.
+ */
+void min_ref(const binconf *b)
+{
+    int id = conf_map_get(&minht, b);
+    assert(id != -1 && min_entries[id].item != 0);
+    if(min_entries[id].refs++ > 0)
+	return;
+    min_size++;
+
+    binconf d;
+    for(int i=1; i<=BINS; i++)
+    {
+	if(min_child(&d, b, min_entries[id].item, i))
+	    min_ref(&d);
+    }
+}
+
+/* Removes a reference to configuration b. If it was the last one, b leaves
+ * the DAG and so do the children which only it referenced; the DAG has no
+ * cycles, as every edge adds an item.
+ */
+void min_unref(const binconf *b)
+{
+    int id = conf_map_get(&minht, b);
+    assert(id != -1 && min_entries[id].refs > 0);
+    if(--min_entries[id].refs > 0)
+	return;
+    min_size--;
+
+    binconf d;
+    for(int i=1; i<=BINS; i++)
+    {
+	if(min_child(&d, b, min_entries[id].item, i))
+	    min_unref(&d);
+    }
+}
+
+/* Switches the entry id of the DAG to item, whose children are completed,
+ * and updates min_size. Only the part of the DAG which enters or leaves it
+ * is visited; the new children are referenced first, so that the parts
+ * shared by the old and the new item stay.
+ */
+void min_set_item(int id, int item)
+{
+    binconf b, d;
+    duplicate(&b, &min_entries[id].conf);
+    int old = min_entries[id].item;
+    min_entries[id].item = item;
+    for(int i=1; i<=BINS; i++)
+    {
+	if(min_child(&d, &b, item, i))
+	    min_ref(&d);
+    }
+    for(int i=1; i<=BINS; i++)
+    {
+	if(min_child(&d, &b, old, i))
+	    min_unref(&d);
+    }
+}
+
+/* One pass over the vertices of the DAG: each of them tries up to MINIMIZE_TRIES
+ * other winning items and keeps the one giving the smallest DAG. The size of the
+ * whole DAG is what counts, as a larger subtree may share more with the rest.
+ * Returns the new size of the DAG.
+ */
+llu min_improve(solver *s, int depth)
+{
+    // the vertices of the current DAG; the list changes when items do
+    int *order = malloc(min_len*sizeof(int)), vertices = 0;
+    for(int id = 0; id < min_len; id++)
+    {
+	if(min_entries[id].refs > 0)
+	    order[vertices++] = id;
+    }
+
+    for(int v = 0; v < vertices && min_explored < MINIMIZE_BUDGET; v++)
+    {
+	int id = order[v];
+	binconf b;
+	duplicate(&b, &min_entries[id].conf);
+	// the vertex may have left the DAG by an earlier change of this pass
+	if(min_entries[id].refs == 0)
+	    continue;
+	min_explored++;
+
+	int items[S+1], tries = 0;
+	int count = min_candidates(s, &b, items);
+	for(int j = 0; j < count && tries < MINIMIZE_TRIES; j++)
+	{
+	    int old = min_entries[id].item;
+	    if(items[j] == old || !min_item_wins(s, &b, items[j], depth+1))
+		continue;
+	    tries++;
+
+	    binconf d;
+	    for(int i=1; i<=BINS; i++)
+	    {
+		if(min_child(&d, &b, items[j], i))
+		    min_complete(s, &d, depth+1);
+	    }
+	    llu size = min_size;
+	    min_set_item(id, items[j]);
+	    if(min_size >= size)
+	    {
+		min_set_item(id, old);
+	    }
+	}
+    }
+    free(order);
+    return min_size;
+}
+
+/* Stores the items of the original game tree as hints, so that the DAG
+ * starts from it. The cached vertices are expanded already.
+ */
+void min_hints(const gametree *tree)
+{
+    if(tree == NULL || tree->leaf == 1 || tree->cached == 1)
+	return;
+    int id = min_entry_of(tree->bc);
+    if(min_entries[id].hint != 0)
+	return;
+    min_entries[id].hint = tree->nextItem;
+    for(int i=1; i<=BINS; i++)
+    {
+	min_hints(tree->next[i]);
+    }
+}
+
+/* Builds the game tree of the DAG below configuration b. Configurations built
+ * earlier in the same (preorder) traversal become cached stubs, which the
+ * output recognizes as present elsewhere in the tree.
+ */
+gametree* min_build(solver *s, const binconf *b, int depth)
+{
+    int id = conf_map_get(&minht, b);
+    assert(id != -1 && min_entries[id].item != 0);
+    int item = min_entries[id].item;
+    gametree *tree = malloc(sizeof(gametree));
+    init_gametree_vertex(s, tree, b, item, depth);
+    min_entries[id].built = tree;
+
+    binconf d;
+    for(int i=1; i<=BINS; i++)
+    {
+	if(b->loads[i] + item >= R)
+	{
+	    tree->next[i] = malloc(sizeof(gametree));
+	    init_gametree_vertex(s, tree->next[i], b, 0, depth+1);
+	    tree->next[i]->leaf = 1;
+	} else if(min_child(&d, b, item, i))
+	{
+	    int c = conf_map_get(&minht, &d);
+	    assert(c != -1);
+	    if(min_entries[c].built != NULL)
+	    {
+		tree->next[i] = malloc(sizeof(gametree));
+		init_gametree_vertex(s, tree->next[i], &d, 0, depth+1);
+		tree->next[i]->cached = 1;
+	    } else {
+		tree->next[i] = min_build(s, &d, depth+1);
+	    }
+	}
+    }
+    return tree;
+}
+
+/* Counts the distinct configurations of a game tree, as they are output;
+ * cached vertices are expanded by expand_cached() as in print_gametree().
+ * Marks the configurations in outht, which needs to be cleared first.
+ */
+llu gametree_dag_size(solver *s, gametree *tree)
+{
+    llu size = 1;
+    conf_map_put(&s->outht, tree->bc, 1);
+
+    for(int i=1; i<=BINS; i++)
+    {
+	if(tree->next[i] == NULL || tree->next[i]->leaf == 1)
+	    continue;
+	if(conf_map_get(&s->outht, tree->next[i]->bc) != -1)
+	    continue;
+
+	if(tree->next[i]->cached == 1)
+	{
+	    expand_cached(s, &(tree->next[i]));
+	}
+	if(tree->next[i]->leaf != 1)
+	{
+	    size += gametree_dag_size(s, tree->next[i]);
+	}
+    }
+    return size;
+}
+
+/* Minimizes the lower bound given by the game tree and returns the tree to be
+ * output, which is the original one if minimization does not make it smaller.
+ * Starts from the DAG of the original tree and improves it pass by pass until
+ * a pass changes nothing or the budget runs out. Reports the sizes.
+ */
+gametree* minimize_gametree(solver *s, gametree *tree)
+{
+    conf_map_clear(&s->outht);
+    llu before = gametree_dag_size(s, tree);
+
+    // the searches below start from the results of the main search
+    local_hashtable_init(s);
+    conf_map_init(&minht);
+    min_len = 0;
+    min_explored = 0;
+    min_hints(tree);
+    binconf root;
+    duplicate(&root, tree->bc);
+    min_complete(s, &root, tree->depth);
+
+    min_size = 0;
+    min_ref(&root);
+    llu size = min_size, last;
+    int passes = 0;
+    do {
+	last = size;
+	size = min_improve(s, tree->depth);
+	passes++;
+    } while(size < last && min_explored < MINIMIZE_BUDGET);
+
+    gametree *minimized = min_build(s, &root, tree->depth);
+    conf_map_clear(&s->outht);
+    llu after = gametree_dag_size(s, minimized);
+    conf_map_clear(&s->outht);
+
+    fprintf(stderr, "Minimization: %llu vertices before, %llu after (%.1f%% reduction), %d passes over %llu vertices.\n",
+	    before, after, before ? 100.0 * ((double) before - (double) after) / before : 0.0, passes, min_explored);
+    conf_map_free(&minht);
+    free(min_entries);
+    min_entries = NULL;
+    min_cap = 0;
+
+    if(after < before)
+    {
+	delete_gametree(tree);
+	return minimized;
+    }
+    delete_gametree(minimized);
+    return tree;
+}
+
+#endif
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+#include "hash.h"
+#include "alloc.h"
+#include "dynprog.h"
+#include "measure.h"
+#include "gs.h"
+#include "dominance.h"
+#include "minimax.h"
+
+// Depth-first proof-number search (df-pn), an alternative to the depth-first
+// minimax of minimax.h. A position where the adversary sends an item is an OR
+// vertex (the adversary needs one winning item), a position where the algorithm
+// packs an item is an AND vertex. The proof number of a vertex is the number
+// of vertices which still need to be proven for the adversary to win, the
+// disproof number the same for the algorithm; the search always expands the
+// vertex which is cheapest to settle. Results are stored in ht and in the
+// dominance index as in the minimax, so that both engines share them; the
+// proof and disproof numbers of unsettled vertices live in the pnht of the solver.
+
+#ifndef _PN_H
+#define _PN_H 1
+
+#define PN_INF (1U << 30)
+
+// An entry of the table of proof and disproof numbers; key 0 is empty.
+struct pn_entry {
+    llu key;
+    unsigned int pn, dn;
+};
+
+typedef struct pn_entry pn_entry;
+
+// The table of solver s is direct-mapped, a new entry always replaces the old one.
+// AND vertices are keyed by their configuration and a salt of the item.
+void pn_init(solver *s)
+{
+    s->pnht = large_alloc(s->pnsize * sizeof(pn_entry));
+    for(int j=0; j<=S; j++)
+    {
+	s->pn_salt[j] = rand_64bit();
+    }
+}
+
+// Forgets the proof and disproof numbers, which depend on item_step.
+void pn_reset(solver *s)
+{
+    if(s->pnht != NULL)
+    {
+	memset(s->pnht, 0, s->pnsize * sizeof(pn_entry));
+    }
+}
+
+void pn_cleanup(solver *s)
+{
+    if(s->pnht != NULL)
+    {
+	large_free(s->pnht);
+	s->pnht = NULL;
+    }
+}
+
+llu pn_key(solver *s, const binconf *b, int item)
+{
+    llu key = b->loadhash ^ b->itemhash;
+    if(item > 0)
+    {
+	key ^= s->pn_salt[item];
+    }
+    return (key == 0) ? 1 : key;
+}
+
+// Reads the numbers of a vertex, or sets the initial ones if it is not stored.
+void pn_lookup(solver *s, const binconf *b, int item, unsigned int initial_pn, unsigned int *pn, unsigned int *dn)
+{
+    llu key = pn_key(s, b, item);
+    pn_entry *e = &s->pnht[key & (s->pnsize-1)];
+    if(e->key == key)
+    {
+	*pn = e->pn;
+	*dn = e->dn;
+    } else {
+	*pn = initial_pn;
+	*dn = 1;
+    }
+}
+
+void pn_store(solver *s, const binconf *b, int item, unsigned int pn, unsigned int dn)
+{
+    llu key = pn_key(s, b, item);
+    pn_entry *e = &s->pnht[key & (s->pnsize-1)];
+    e->key = key;
+    e->pn = pn;
+    e->dn = dn;
+}
+
+unsigned int pn_add(unsigned int a, unsigned int b)
+{
+    return (a + b >= PN_INF) ? PN_INF : a + b;
+}
+
+// Stores a settled OR vertex where the minimax would: 0 is a win of the adversary
+// by the item refuting.
+void pn_settle(solver *s, const binconf *b, int value, int refuting)
+{
+    if(s->search_aborted || (value == 1 && s->item_step > 1))
+	return;
+    conf_hashpush_refuting(&s->ht, b, value, refuting);
+#ifdef DOMINANCE
+    dominance_push(s, b, value, refuting);
+#endif
+}
+
+/* The value of an OR vertex known without expanding it, as in algorithm():
+ * 1 if the algorithm wins, 0 if the adversary wins, -1 if it is not known.
+ */
+int pn_known(solver *s, const binconf *d)
+{
+    if((d->loads[BINS] + (BINS*S - totalload(d))) < R)
+	return 1;
+    int tb = tablebase_probe(s, d);
+    if(tb != -1)
+	return (tb == 0) ? 1 : 0;
+    int c = is_conf_hashed(&s->ht, d);
+#ifdef DOMINANCE
+    if(c == -1)
+	c = dominance_lookup(s, d);
+#endif
+    return c;
+}
+
+// Children of an AND vertex: the configurations after packing k into b,
+// where the loads of the bins differ. Returns their number.
+int pn_children(const binconf *b, int k, binconf *d)
+{
+    int children = 0;
+    for(int i=1; i<=BINS; i++)
+    {
+	if(b->loads[i] + k >= R || (i > 1 && b->loads[i] == b->loads[i-1]))
+	    continue;
+	duplicate(&d[children], b);
+	d[children].loads[i] += k;
+	d[children].items[k]++;
+	sortloads(&d[children]);
+	rehash(&d[children], b, k);
+	children++;
+    }
+    return children;
+}
+
+void pn_or(solver *s, const binconf *b, unsigned int thpn, unsigned int thdn, unsigned int *pn, unsigned int *dn, int *item);
+
+/* Expands the AND vertex of b with item k until its proof number reaches thpn
+ * or its disproof number reaches thdn; the numbers are returned in pn and dn.
+ */
+void pn_and(solver *s, const binconf *b, int k, unsigned int thpn, unsigned int thdn, unsigned int *pn, unsigned int *dn)
+{
+#if BINS == 3
+    if(gsheuristic(b, k) == 1)
+    {
+	*pn = PN_INF;
+	*dn = 0;
+	pn_store(s, b, k, *pn, *dn);
+	return;
+    }
+#endif
+
+    binconf d[BINS];
+    unsigned int cpn[BINS], cdn[BINS];
+    int children = pn_children(b, k, d);
+    for(int j = 0; j < children; j++)
+    {
+	int c = pn_known(s, &d[j]);
+	if(c == 0)
+	{
+	    cpn[j] = 0;
+	    cdn[j] = PN_INF;
+	} else if(c == 1)
+	{
+	    cpn[j] = PN_INF;
+	    cdn[j] = 0;
+	} else {
+	    pn_lookup(s, &d[j], 0, 1, &cpn[j], &cdn[j]);
+	}
+    }
+
+    while(true)
+    {
+	// the adversary needs all children, the algorithm one of them
+	int best = -1;
+	unsigned int dn2 = PN_INF;
+	*pn = 0;
+	*dn = PN_INF;
+	for(int j = 0; j < children; j++)
+	{
+	    *pn = pn_add(*pn, cpn[j]);
+	    if(cdn[j] < *dn)
+	    {
+		dn2 = *dn;
+		*dn = cdn[j];
+		best = j;
+	    } else if(cdn[j] < dn2)
+	    {
+		dn2 = cdn[j];
+	    }
+	}
+	if(children == 0)
+	{
+	    *pn = 0; // the algorithm cannot pack the item at all
+	}
+	if(*pn == 0)
+	{
+	    *dn = PN_INF;
+	} else if(*dn == 0)
+	{
+	    *pn = PN_INF;
+	}
+	if(*pn >= thpn || *dn >= thdn || *pn == 0 || *dn == 0 || s->search_aborted)
+	    break;
+
+	int item;
+	unsigned int cthdn = (dn2 + 1 < thdn) ? dn2 + 1 : thdn;
+	unsigned int cthpn = thpn - *pn + cpn[best];
+	pn_or(s, &d[best], cthpn, cthdn, &cpn[best], &cdn[best], &item);
+    }
+    pn_store(s, b, k, *pn, *dn);
+}
+
+/* Expands the OR vertex of b until its proof number reaches thpn or its
+ * disproof number reaches thdn; the numbers are returned in pn and dn.
+ * If the adversary wins, item is the item which wins.
+ */
+void pn_or(solver *s, const binconf *b, unsigned int thpn, unsigned int thdn, unsigned int *pn, unsigned int *dn, int *item)
+{
+    if(s->abort_check != NULL && ((++s->abort_counter) & 0xfff) == 0)
+    {
+	s->abort_check(s);
+    }
+#ifdef MEASURE
+    s->measure.pn_expansions++;
+#endif
+    *item = 0;
+
+#ifdef ADV_HEURISTIC
+    int moves[BINS+ADV_HEURISTIC_K];
+    if(adversary_heuristic(s, b, moves) > 0)
+    {
+	*pn = 0;
+	*dn = PN_INF;
+	*item = moves[0];
+	pn_store(s, b, 0, *pn, *dn);
+	pn_settle(s, b, 0, *item);
+	return;
+    }
+#endif
+
+    int res[BINS+ADV_HEURISTIC_K];
+    MAXIMUM_FEASIBLE(s, b, res);
+    int items = res[0];
+    unsigned int cpn[S+1], cdn[S+1];
+    binconf d[BINS];
+    // items from the largest, the order of adversary()
+    for(int j = 0; j < items; j++)
+    {
+	if((items - j) % s->item_step != 0)
+	{
+	    // not sent in the coarse game, as if the algorithm won
+	    cpn[j] = PN_INF;
+	    cdn[j] = 0;
+	    continue;
+	}
+	// the initial proof number of an AND vertex is its number of children
+	pn_lookup(s, b, items - j, pn_children(b, items - j, d), &cpn[j], &cdn[j]);
+    }
+
+    while(true)
+    {
+	// the adversary needs one child, the algorithm all of them
+	int best = -1;
+	unsigned int pn2 = PN_INF;
+	*pn = PN_INF;
+	*dn = 0;
+	for(int j = 0; j < items; j++)
+	{
+	    *dn = pn_add(*dn, cdn[j]);
+	    if(cpn[j] < *pn)
+	    {
+		pn2 = *pn;
+		*pn = cpn[j];
+		best = j;
+	    } else if(cpn[j] < pn2)
+	    {
+		pn2 = cpn[j];
+	    }
+	}
+	if(*pn == 0)
+	{
+	    *dn = PN_INF;
+	    *item = items - best;
+	} else if(*dn == 0)
+	{
+	    *pn = PN_INF;
+	}
+	if(*pn >= thpn || *dn >= thdn || *pn == 0 || *dn == 0 || s->search_aborted)
+	    break;
+
+	unsigned int cthpn = (pn2 + 1 < thpn) ? pn2 + 1 : thpn;
+	unsigned int cthdn = thdn - *dn + cdn[best];
+	pn_and(s, b, items - best, cthpn, cthdn, &cpn[best], &cdn[best]);
+    }
+
+    pn_store(s, b, 0, *pn, *dn);
+    if(*pn == 0)
+    {
+	pn_settle(s, b, 0, *item);
+    } else if(*dn == 0)
+    {
+	pn_settle(s, b, 1, 0);
+    }
+}
+
+/* Evaluates the configuration b by df-pn, as evaluate() does by the minimax.
+ * If the adversary wins, the game tree is the vertex of b with the winning
+ * item; its children are cached vertices, which print_gametree() evaluates
+ * in turn. Returns 0 if the adversary wins, 1 if the algorithm does.
+ */
+int pn_evaluate(solver *s, const binconf *b, gametree **rettree, int depth)
+{
+    unsigned int pn, dn;
+    int item;
+
+    if((b->loads[BINS] + (BINS*S - totalload(b))) < R)
+    {
+	return 1;
+    }
+    pn_or(s, b, PN_INF, PN_INF, &pn, &dn, &item);
+    if(pn != 0 || s->search_aborted)
+    {
+	return 1;
+    }
+
+    gametree *t = malloc(sizeof(gametree));
+    init_gametree_vertex(s, t, b, item, depth);
+    for(int i=1; i<=BINS; i++)
+    {
+	if(b->loads[i] + item >= R)
+	{
+	    t->next[i] = malloc(sizeof(gametree));
+	    init_gametree_vertex(s, t->next[i], b, 0, depth+1);
+	    t->next[i]->leaf = 1;
+	} else if(i == 1 || b->loads[i] != b->loads[i-1])
+	{
+	    binconf d;
+	    duplicate(&d, b);
+	    d.loads[i] += item;
+	    d.items[item]++;
+	    sortloads(&d);
+	    rehash(&d, b, item);
+	    t->next[i] = malloc(sizeof(gametree));
+	    init_gametree_vertex(s, t->next[i], &d, 0, depth+1);
+	    t->next[i]->cached = 1;
+	}
+    }
+    *rettree = t;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+#include "hash.h"
+#include "dynprog.h"
+#include "measure.h"
+#include "gs.h"
+#include "minimax.h"
+
+// Retrograde (bottom-up) engine: the configurations reachable from the root
+// are enumerated layer by layer by their total load, then evaluated once each
+// from the fullest layer down. A layer is a sorted array of packed
+// configurations with dense arrays of results, so children are found by binary
+// search in the layer of their total load and no hash table is needed; the
+// dynamic programming and the good situations are shared with the minimax.
+// Every reachable configuration is kept, so this only suits smaller instances.
+
+#ifndef _RETRO_H
+#define _RETRO_H 1
+
+// a configuration packed as its loads followed by its item counts
+#define RETRO_KEY (BINS+S)
+#define RETRO_LAYERS (BINS*S+1)
+
+// The configurations of the same total load.
+struct retro_layer {
+    unsigned char *keys; // len keys of RETRO_KEY bytes, sorted once sealed
+    signed char *value; // 1 if the algorithm wins, 0 if the adversary does, -1 if not known yet
+    unsigned char *item; // the winning item of the adversary, 0 for a refuting k-move
+    bool *built; // already in the output game tree
+    llu len, cap;
+    bool sealed;
+};
+
+typedef struct retro_layer retro_layer;
+
+retro_layer retro_layers[RETRO_LAYERS];
+llu retro_configurations = 0;
+llu retro_bytes = 0; // allocated for keys
+
+void retro_pack(const binconf *b, unsigned char *key)
+{
+    for(int i=1; i<=BINS; i++)
+    {
+	key[i-1] = (unsigned char) b->loads[i];
+    }
+    for(int j=1; j<=S; j++)
+    {
+	key[BINS+j-1] = (unsigned char) b->items[j];
+    }
+}
+
+void retro_unpack(const unsigned char *key, binconf *b)
+{
+    init(b);
+    for(int i=1; i<=BINS; i++)
+    {
+	b->loads[i] = (char) key[i-1];
+    }
+    for(int j=1; j<=S; j++)
+    {
+	b->items[j] = (char) key[BINS+j-1];
+    }
+    hashinit(b);
+}
+
+int retro_compare(const void *a, const void *b)
+{
+    return memcmp(a, b, RETRO_KEY);
+}
+
+// Sorts the keys of the layer and removes duplicates.
+void retro_compact(retro_layer *l)
+{
+    if(l->len == 0)
+	return;
+    qsort(l->keys, l->len, RETRO_KEY, retro_compare);
+    llu unique = 1;
+    for(llu c = 1; c < l->len; c++)
+    {
+	if(memcmp(l->keys + c*RETRO_KEY, l->keys + (unique-1)*RETRO_KEY, RETRO_KEY) != 0)
+	{
+	    memmove(l->keys + unique*RETRO_KEY, l->keys + c*RETRO_KEY, RETRO_KEY);
+	    unique++;
+	}
+    }
+    l->len = unique;
+}
+
+/* Appends b to a layer not sealed yet. A full layer is compacted first, as
+ * a configuration is usually reached from many parents; it only grows if
+ * compacting does not free half of it.
+ */
+void retro_push(int t, const binconf *b)
+{
+    retro_layer *l = &retro_layers[t];
+    assert(!l->sealed);
+    if(l->len == l->cap)
+    {
+	retro_compact(l);
+	if(2*l->len >= l->cap)
+	{
+	    llu grown = (l->cap == 0) ? 1024 : 2*l->cap;
+	    retro_bytes += (grown - l->cap) * RETRO_KEY;
+	    if(retro_bytes > ((llu) RETRO_MEMORY << 20))
+	    {
+		fprintf(stderr, "Retrograde analysis needs more than %d MB (RETRO_MEMORY); use another engine.\n", RETRO_MEMORY);
+		exit(-1);
+	    }
+	    l->cap = grown;
+	    l->keys = realloc(l->keys, l->cap * RETRO_KEY);
+	    assert(l->keys != NULL);
+	}
+    }
+    retro_pack(b, l->keys + l->len * RETRO_KEY);
+    l->len++;
+}
+
+// Compacts the layer for good and allocates its results.
+void retro_seal(int t)
+{
+    retro_layer *l = &retro_layers[t];
+    retro_compact(l);
+    llu n = (l->len > 0) ? l->len : 1;
+    retro_bytes = retro_bytes - l->cap * RETRO_KEY + n * RETRO_KEY;
+    l->cap = n;
+    l->keys = realloc(l->keys, n * RETRO_KEY);
+    l->value = malloc(n * sizeof(signed char));
+    l->item = calloc(n, sizeof(unsigned char));
+    l->built = calloc(n, sizeof(bool));
+    memset(l->value, -1, n * sizeof(signed char));
+    l->sealed = true;
+    retro_configurations += l->len;
+}
+
+void retro_free()
+{
+    for(int t = 0; t < RETRO_LAYERS; t++)
+    {
+	free(retro_layers[t].keys);
+	free(retro_layers[t].value);
+	free(retro_layers[t].item);
+	free(retro_layers[t].built);
+	memset(&retro_layers[t], 0, sizeof(retro_layer));
+    }
+    retro_configurations = 0;
+    retro_bytes = 0;
+}
+
+// Returns the index of b in the layer of its total load, or -1 if it is not there.
+long long retro_find(const binconf *b)
+{
+    int t = totalload(b);
+    if(t >= RETRO_LAYERS || !retro_layers[t].sealed || retro_layers[t].len == 0)
+	return -1;
+    retro_layer *l = &retro_layers[t];
+    unsigned char key[RETRO_KEY];
+    retro_pack(b, key);
+    unsigned char *found = bsearch(key, l->keys, l->len, RETRO_KEY, retro_compare);
+    if(found == NULL)
+	return -1;
+    return (found - l->keys) / RETRO_KEY;
+}
+
+bool retro_algorithm_wins(const binconf *d)
+{
+    return (d->loads[BINS] + (BINS*S - totalload(d))) < R;
+}
+
+/* Calls visit(d) for every child d of the configuration b after the
+ * algorithm packs item k, as long as visit() returns true. Returns false if
+ * visit() does or if b with k is a good situation of the algorithm, so the
+ * return value tells whether the adversary wins by k if visit() tells
+ * whether it wins d.
+ */
+bool retro_children(const binconf *b, int k, bool (*visit)(const binconf *d))
+{
+#if BINS == 3
+    if(gsheuristic(b, k) == 1)
+	return false;
+#endif
+    for(int i=1; i<=BINS; i++)
+    {
+	if(b->loads[i] + k >= R || (i > 1 && b->loads[i] == b->loads[i-1]))
+	    continue;
+	binconf d;
+	duplicate(&d, b);
+	d.loads[i] += k;
+	d.items[k]++;
+	sortloads(&d);
+	rehash(&d, b, k);
+	if(!visit(&d))
+	    return false;
+    }
+    return true;
+}
+
+// The obvious wins of the algorithm are not enumerated.
+bool retro_enqueue(const binconf *d)
+{
+    if(!retro_algorithm_wins(d))
+	retro_push(totalload(d), d);
+    return true;
+}
+
+bool retro_child_lost(const binconf *d)
+{
+    if(retro_algorithm_wins(d))
+	return false;
+    long long c = retro_find(d);
+    assert(c != -1);
+    return retro_layers[totalload(d)].value[c] == 0;
+}
+
+/* Enumerates the configurations reachable from the root by increasing total
+ * load; a configuration refuted by a k-move of the adversary gets its result
+ * at once and has no children.
+ */
+void retro_enumerate(solver *s, const binconf *root)
+{
+    int res[BINS+ADV_HEURISTIC_K];
+    binconf b;
+    retro_push(totalload(root), root);
+    for(int t = totalload(root); t < RETRO_LAYERS; t++)
+    {
+	retro_seal(t);
+	retro_layer *l = &retro_layers[t];
+	for(llu c = 0; c < l->len; c++)
+	{
+	    retro_unpack(l->keys + c*RETRO_KEY, &b);
+	    if(retro_algorithm_wins(&b))
+	    {
+		l->value[c] = 1;
+		continue;
+	    }
+#ifdef ADV_HEURISTIC
+	    if(adversary_heuristic(s, &b, res) > 0)
+	    {
+		l->value[c] = 0;
+		l->item[c] = 0;
+		continue;
+	    }
+#endif
+	    MAXIMUM_FEASIBLE(s, &b, res);
+	    for(int k = res[0]; k > 0; k--)
+	    {
+		if(k % s->item_step == 0)
+		    retro_children(&b, k, retro_enqueue);
+	    }
+	}
+    }
+}
+
+/* Evaluates the layers from the fullest one down; the adversary tries the
+ * items in the order of adversary(), so the winning items match the minimax.
+ */
+void retro_evaluate_layers(solver *s, int first)
+{
+    int res[BINS+ADV_HEURISTIC_K];
+    binconf b;
+    for(int t = RETRO_LAYERS-1; t >= first; t--)
+    {
+	retro_layer *l = &retro_layers[t];
+	for(llu c = 0; c < l->len; c++)
+	{
+	    if(l->value[c] != -1)
+		continue;
+	    retro_unpack(l->keys + c*RETRO_KEY, &b);
+	    MAXIMUM_FEASIBLE(s, &b, res);
+	    l->value[c] = 1;
+	    for(int k = res[0]; k > 0; k--)
+	    {
+		if(k % s->item_step == 0 && retro_children(&b, k, retro_child_lost))
+		{
+		    l->value[c] = 0;
+		    l->item[c] = (unsigned char) k;
+		    break;
+		}
+	    }
+	}
+    }
+}
+
+#ifdef RETRO_CROSSCHECK
+/* Compares every RETRO_CROSSCHECK-th configuration of each layer with the
+ * result of the minimax; a difference is fatal.
+ */
+void retro_crosscheck(solver *s)
+{
+    binconf b;
+    llu checked = 0;
+    for(int t = 0; t < RETRO_LAYERS; t++)
+    {
+	retro_layer *l = &retro_layers[t];
+	for(llu c = 0; c < l->len; c += RETRO_CROSSCHECK)
+	{
+	    retro_unpack(l->keys + c*RETRO_KEY, &b);
+	    gametree *v = malloc(sizeof(gametree));
+	    init_gametree_vertex(s, v, &b, 0, 0);
+	    int r = ADVERSARY(s, &b, 0, v, 1);
+	    delete_gametree(v);
+	    if(r != l->value[c])
+	    {
+		fprintf(stderr, "Retrograde result %d differs from the minimax result %d at:\n", l->value[c], r);
+		print_binconf(&b);
+		exit(-1);
+	    }
+	    checked++;
+	}
+    }
+    fprintf(stderr, "Cross-check: %llu configurations agree with the minimax.\n", checked);
+}
+#endif
+
+// Solves all configurations reachable from the root; earlier results are dropped.
+void retro_solve(solver *s, const binconf *root)
+{
+    retro_free();
+    retro_enumerate(s, root);
+    retro_evaluate_layers(s, totalload(root));
+    llu bytes = retro_configurations * (RETRO_KEY + sizeof(signed char) + sizeof(unsigned char) + sizeof(bool));
+    fprintf(stderr, "Retrograde analysis: %llu configurations, %.1f MB.\n", retro_configurations, bytes / (1024.0*1024.0));
+#ifdef RETRO_CROSSCHECK
+    retro_crosscheck(s);
+#endif
+}
+
+/* Builds the game tree of the adversary's strategy below configuration b,
+ * which it wins. Configurations built earlier become cached stubs, which
+ * print_gametree() finds elsewhere in the output or evaluates again.
+ */
+gametree* retro_build(solver *s, const binconf *b, int depth)
+{
+    int t = totalload(b);
+    long long c = retro_find(b);
+    assert(c != -1 && retro_layers[t].value[c] == 0);
+    retro_layers[t].built[c] = true;
+    int item = retro_layers[t].item[c];
+
+    if(item == 0)
+    {
+	// refuted by a k-move, built as in adversary()
+	int moves[BINS+ADV_HEURISTIC_K];
+	int k = adversary_heuristic(s, b, moves);
+	assert(k > 0);
+	gametree parent;
+	parent.depth = depth-1;
+	heuristic_gametree(s, b, moves, k, &parent, 1);
+	return parent.next[1];
+    }
+
+    gametree *tree = malloc(sizeof(gametree));
+    init_gametree_vertex(s, tree, b, item, depth);
+    for(int i=1; i<=BINS; i++)
+    {
+	if(b->loads[i] + item >= R)
+	{
+	    tree->next[i] = malloc(sizeof(gametree));
+	    init_gametree_vertex(s, tree->next[i], b, 0, depth+1);
+	    tree->next[i]->leaf = 1;
+	} else if(i == 1 || b->loads[i] != b->loads[i-1])
+	{
+	    binconf d;
+	    duplicate(&d, b);
+	    d.loads[i] += item;
+	    d.items[item]++;
+	    sortloads(&d);
+	    rehash(&d, b, item);
+	    long long dc = retro_find(&d);
+	    assert(dc != -1);
+	    if(retro_layers[totalload(&d)].built[dc])
+	    {
+		tree->next[i] = malloc(sizeof(gametree));
+		init_gametree_vertex(s, tree->next[i], &d, 0, depth+1);
+		tree->next[i]->cached = 1;
+	    } else {
+		tree->next[i] = retro_build(s, &d, depth+1);
+	    }
+	}
+    }
+    return tree;
+}
+
+/* Evaluates the configuration b by retrograde analysis, as evaluate() does by
+ * the minimax. Configurations reachable from the last root are answered from
+ * its layers, others are solved anew. Returns 0 if the adversary wins.
+ */
+int retro_evaluate(solver *s, const binconf *b, gametree **rettree, int depth)
+{
+    if(retro_algorithm_wins(b))
+	return 1;
+    long long c = retro_find(b);
+    if(c == -1)
+    {
+	retro_solve(s, b);
+	c = retro_find(b);
+	assert(c != -1);
+    }
+    if(retro_layers[totalload(b)].value[c] == 1)
+	return 1;
+    *rettree = retro_build(s, b, depth);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "measure.h"
+#include "hash.h"
+
+// The state of one solver: its caches, the scratch arrays of the dynamic
+// programming, the control of the running search and the counters. It is
+// passed to everything that searches, so several solvers (of the same R and
+// S, which are compile-time constants) can run in one process, e.g. one per
+// thread. The Zobrist tables and the tablebase are read-only and shared.
+
+#ifndef _SOLVER_H
+#define _SOLVER_H 1
+
+struct kmove_cache_item;
+struct pn_entry;
+struct th_entry;
+
+struct solver {
+    // generic hash table (for configurations)
+    conf_hashtable ht;
+    // configurations already output, and their ids in a certificate; exact
+    conf_map outht;
+    // dominance index: configurations with the same loads share a bucket
+    conf_hashtable domht;
+    // hash table for dynamic programming calls / feasibility checks
+    dp_hashtable dpht;
+
+    // binary array of feasibilities and the queues of sparse_dynprog_test()
+    char *F;
+    int *oldqueue;
+    int *newqueue;
+
+    // cache of k_move() results, KMOVE_CACHESIZE entries
+    struct kmove_cache_item *kmove_cache;
+    // tables of the proof-number search and of the threshold search, if used
+    struct pn_entry *pnht;
+    llu pnsize; // entries of pnht, a power of two
+    llu pn_salt[S+1];
+    struct th_entry *thht;
+    llu thsize; // entries of thht, a power of two
+
+    // for indexing the game tree vertices
+    llu treeid;
+
+    /* Set when the current search should be abandoned, e.g. when a distributed
+     * task is cancelled. The results of an aborted search are meaningless
+     * and are not cached.
+     */
+    bool search_aborted;
+    // if not NULL, called periodically by adversary(); may set search_aborted
+    void (*abort_check)(struct solver *s);
+    llu abort_counter;
+
+    /* The adversary sends only items divisible by item_step, apart from the
+     * refuting k-moves. With item_step > 1 the game is coarser and the adversary
+     * weaker: its wins hold for the full game and are cached, the wins of the
+     * algorithm do not and are not cached.
+     */
+    int item_step;
+
+    measure_counters measure;
+};
+
+typedef struct solver solver;
+
+/* Sets up a solver with the default sizes of its tables, which memory_plan()
+ * may change; solver_alloc() allocates them.
+ */
+void solver_init(solver *s)
+{
+    memset(s, 0, sizeof(solver));
+    s->ht = (conf_hashtable) {.size = HASHSIZE, .chainlen = CHAINLEN};
+    s->domht = (conf_hashtable) {.size = HASHSIZE/4, .chainlen = CHAINLEN, .byloads = true};
+    s->dpht = (dp_hashtable) {.size = HASHSIZE, .chainlen = CHAINLEN};
+    s->pnsize = PN_HASHSIZE;
+    s->thsize = TH_HASHSIZE;
+    s->treeid = 1;
+    s->item_step = 1;
+}
+
+// Run at the start of each evaluate(); results of earlier evaluations are kept.
+void local_hashtable_init(solver *s)
+{
+    conf_hashtable_new_generation(&s->ht);
+#ifdef DOMINANCE
+    conf_hashtable_new_generation(&s->domht);
+#endif
+}
+
+/* Initialize the game tree with the information in the parameters. */
+
+void init_gametree_vertex(solver *s, gametree *tree, const binconf *b, int nextItem, int depth)
+{
+    tree->bc = malloc(sizeof(binconf));
+    init(tree->bc);
+
+    tree->cached=0; tree->leaf=0;
+    tree->id = ++s->treeid;
+    // tree->cached_conf = NULL;
+    tree->depth = depth;
+
+    duplicate(tree->bc, b);
+
+    for(int i=1; i <= BINS; i++)
+    {
+	tree->next[i] = NULL;
+    }
+    tree->nextItem = nextItem;
+}
+
+#endif
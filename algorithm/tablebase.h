@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "hash.h"
+#include "dynprog.h"
+#include "gs.h"
+#include "solver.h"
+
+// Endgame tablebase: the results of all configurations with little volume
+// left, BINS*S - totalload(b) <= tb_volume, solved exhaustively and kept in a
+// file which is memory-mapped by later runs.
+//
+// The file starts with a header of 16 bytes: "BSTB", a version byte, BINS,
+// R and S as little-endian 16-bit numbers, the volume as a 16-bit number and
+// four zero bytes. It continues with volume+2 little-endian 64-bit offsets:
+// the records of volume v are the ones from offsets[v] to offsets[v+1].
+// A record is a configuration won by the adversary, as BINS loads and S item
+// counts of one byte, followed by the item the adversary sends. The records
+// of each volume are sorted. Configurations of the tablebase which have no
+// record are won by the algorithm.
+
+#ifndef _TABLEBASE_H
+#define _TABLEBASE_H 1
+
+#define TB_MAGIC "BSTB"
+#define TB_VERSION 1
+#define TB_HEADER 16
+#define TB_KEY (BINS+S)
+#define TB_RECORD (TB_KEY+1)
+
+// the largest volume covered, -1 if there is no tablebase
+int tb_volume = -1;
+// the records and their number for each volume up to tb_volume
+const unsigned char *tb_records[BINS*S+1];
+llu tb_count[BINS*S+1];
+// the mapped file, if the tablebase was read
+void *tb_map = NULL;
+size_t tb_map_size = 0;
+
+int tb_compare(const void *a, const void *b)
+{
+    return memcmp(a, b, TB_KEY);
+}
+
+void tb_pack(const binconf *b, unsigned char *key)
+{
+    for(int i=1; i<=BINS; i++)
+    {
+	key[i-1] = (unsigned char) b->loads[i];
+    }
+    for(int j=1; j<=S; j++)
+    {
+	key[BINS+j-1] = (unsigned char) b->items[j];
+    }
+}
+
+bool tb_algorithm_wins(const binconf *d)
+{
+    return (d->loads[BINS] + (BINS*S - totalload(d))) < R;
+}
+
+/* Looks up configuration b. Returns -1 if it is not covered by the tablebase,
+ * 0 if the algorithm wins and the winning item if the adversary does.
+ */
+int tablebase_probe(solver *s, const binconf *b)
+{
+    int volume = BINS*S - totalload(b);
+    if(volume > tb_volume)
+	return -1;
+    if(tb_count[volume] == 0)
+	return 0;
+    unsigned char key[TB_KEY];
+    tb_pack(b, key);
+    const unsigned char *found = bsearch(key, tb_records[volume], tb_count[volume], TB_RECORD, tb_compare);
+    if(found == NULL)
+	return 0;
+    (void) s; // counts the hits with MEASURE only
+#ifdef MEASURE
+    s->measure.tb_hits++;
+#endif
+    return found[TB_KEY];
+}
+
+/* Solves configuration b from the results of the smaller volumes, in the order
+ * of adversary(). Returns the winning item of the adversary, or 0.
+ */
+int tb_solve(solver *s, const binconf *b)
+{
+    int res[BINS+ADV_HEURISTIC_K];
+    maximum_feasible_dynprog(s, b, res);
+    for(int k = res[0]; k > 0; k--)
+    {
+#if BINS == 3
+	if(gsheuristic(b, k) == 1)
+	    continue;
+#endif
+	bool wins = true;
+	for(int i=1; i<=BINS && wins; i++)
+	{
+	    if(b->loads[i] + k >= R || (i > 1 && b->loads[i] == b->loads[i-1]))
+		continue;
+	    binconf d;
+	    duplicate(&d, b);
+	    d.loads[i] += k;
+	    d.items[k]++;
+	    sortloads(&d);
+	    rehash(&d, b, k);
+	    wins = !tb_algorithm_wins(&d) && tablebase_probe(s, &d) > 0;
+	}
+	if(wins)
+	    return k;
+    }
+    return 0;
+}
+
+// Configurations of one volume being generated, as records.
+unsigned char *tb_layer = NULL;
+llu tb_layer_len = 0, tb_layer_cap = 0;
+
+// Sorts the layer and removes configurations present more than once.
+void tb_layer_compact()
+{
+    if(tb_layer_len == 0)
+	return;
+    qsort(tb_layer, tb_layer_len, TB_RECORD, tb_compare);
+    llu unique = 1;
+    for(llu c = 1; c < tb_layer_len; c++)
+    {
+	if(memcmp(tb_layer + c*TB_RECORD, tb_layer + (unique-1)*TB_RECORD, TB_KEY) != 0)
+	{
+	    memmove(tb_layer + unique*TB_RECORD, tb_layer + c*TB_RECORD, TB_RECORD);
+	    unique++;
+	}
+    }
+    tb_layer_len = unique;
+}
+
+// The same items come from different partitions of the loads, so a full
+// layer is compacted first and only grows if that does not free half of it.
+void tb_layer_push(const unsigned char *record)
+{
+    if(tb_layer_len == tb_layer_cap)
+    {
+	tb_layer_compact();
+	if(2*tb_layer_len >= tb_layer_cap)
+	{
+	    tb_layer_cap = (tb_layer_cap == 0) ? 1024 : 2*tb_layer_cap;
+	    tb_layer = realloc(tb_layer, tb_layer_cap * TB_RECORD);
+	    assert(tb_layer != NULL);
+	}
+    }
+    memcpy(tb_layer + tb_layer_len * TB_RECORD, record, TB_RECORD);
+    tb_layer_len++;
+}
+
+/* Adds the configurations with the given loads whose items form a partition of
+ * the loads of bins bin, ..., BINS into items of at most S; parts of bin come
+ * in non-increasing order, at most largest.
+ */
+void tb_partitions(binconf *b, int bin, int rest, int largest)
+{
+    if(rest == 0)
+    {
+	if(bin == BINS)
+	{
+	    unsigned char record[TB_RECORD];
+	    tb_pack(b, record);
+	    record[TB_KEY] = 0;
+	    tb_layer_push(record);
+	} else {
+	    tb_partitions(b, bin+1, b->loads[bin+1], S);
+	}
+	return;
+    }
+    for(int item = (rest < largest) ? rest : largest; item > 0; item--)
+    {
+	b->items[item]++;
+	tb_partitions(b, bin, rest - item, item);
+	b->items[item]--;
+    }
+}
+
+/* Adds the configurations of the given volume which are not won by the
+ * algorithm at once: loads in non-increasing order from bin on, with the
+ * given rest of the total load, none of them below R - volume.
+ */
+void tb_loads(binconf *b, int volume, int bin, int rest)
+{
+    if(bin > BINS)
+    {
+	if(rest == 0)
+	{
+	    tb_partitions(b, 1, b->loads[1], S);
+	}
+	return;
+    }
+    int high = (bin == 1) ? R-1 : b->loads[bin-1];
+    for(int load = (high < rest) ? high : rest; load >= R - volume && load >= 0; load--)
+    {
+	b->loads[bin] = load;
+	tb_loads(b, volume, bin+1, rest - load);
+    }
+    b->loads[bin] = 0;
+}
+
+/* Solves all configurations of the given volume, whose smaller volumes are
+ * solved already, and keeps the ones won by the adversary.
+ * Returns the number of configurations solved.
+ */
+llu tb_generate_volume(solver *s, int volume)
+{
+    binconf b;
+    init(&b);
+    tb_layer_len = 0;
+    tb_loads(&b, volume, 1, BINS*S - volume);
+
+    tb_layer_compact();
+    llu solved = 0, won = 0;
+    for(llu c = 0; c < tb_layer_len; c++)
+    {
+	unsigned char *record = tb_layer + c*TB_RECORD;
+	init(&b);
+	for(int i=1; i<=BINS; i++)
+	{
+	    b.loads[i] = (char) record[i-1];
+	}
+	for(int j=1; j<=S; j++)
+	{
+	    b.items[j] = (char) record[BINS+j-1];
+	}
+	hashinit(&b);
+	// only configurations the optimum can pack are reachable
+	if(!TEST(s, &b))
+	    continue;
+	solved++;
+	int item = tb_solve(s, &b);
+	if(item > 0)
+	{
+	    // won records are moved to the front, keeping the order
+	    memmove(tb_layer + won*TB_RECORD, record, TB_KEY);
+	    tb_layer[won*TB_RECORD + TB_KEY] = (unsigned char) item;
+	    won++;
+	}
+    }
+
+    unsigned char *records = malloc((won > 0 ? won : 1) * TB_RECORD);
+    memcpy(records, tb_layer, won * TB_RECORD);
+    tb_records[volume] = records;
+    tb_count[volume] = won;
+    tb_volume = volume;
+    return solved;
+}
+
+void tb_put_u16(FILE *f, int x)
+{
+    fputc(x & 0xff, f);
+    fputc((x >> 8) & 0xff, f);
+}
+
+void tb_put_u64(FILE *f, llu x)
+{
+    for(int i = 0; i < 8; i++)
+    {
+	fputc((int) ((x >> (8*i)) & 0xff), f);
+    }
+}
+
+/* Generates the tablebase up to the given volume and writes it to the file.
+ * Returns false if the file cannot be written.
+ */
+bool tablebase_generate(solver *s, const char *filename, int volume)
+{
+    for(int v = 0; v <= volume; v++)
+    {
+	llu solved = tb_generate_volume(s, v);
+	if(solved > 0)
+	{
+	    fprintf(stderr, "Tablebase volume %d: %llu configurations, %llu won by the adversary.\n", v, solved, tb_count[v]);
+	}
+    }
+    free(tb_layer);
+    tb_layer = NULL;
+    tb_layer_cap = 0;
+
+    FILE *f = fopen(filename, "wb");
+    if(f == NULL)
+    {
+	fprintf(stderr, "Cannot open %s for writing.\n", filename);
+	return false;
+    }
+    fputs(TB_MAGIC, f);
+    fputc(TB_VERSION, f);
+    fputc(BINS, f);
+    tb_put_u16(f, R);
+    tb_put_u16(f, S);
+    tb_put_u16(f, volume);
+    tb_put_u16(f, 0);
+    tb_put_u16(f, 0);
+    llu offset = 0;
+    for(int v = 0; v <= volume; v++)
+    {
+	tb_put_u64(f, offset);
+	offset += tb_count[v];
+    }
+    tb_put_u64(f, offset);
+    for(int v = 0; v <= volume; v++)
+    {
+	fwrite(tb_records[v], TB_RECORD, tb_count[v], f);
+    }
+    bool ok = (ferror(f) == 0);
+    ok &= (fclose(f) == 0);
+    fprintf(stderr, "Wrote a tablebase of volume %d with %llu records to %s.\n", volume, offset, filename);
+    return ok;
+}
+
+unsigned int tb_get_u16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+llu tb_get_u64(const unsigned char *p)
+{
+    llu x = 0;
+    for(int i = 0; i < 8; i++)
+    {
+	x |= (llu) p[i] << (8*i);
+    }
+    return x;
+}
+
+/* Maps the tablebase file into memory. Returns false if it cannot be read
+ * or is for another instance.
+ */
+bool tablebase_read(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if(fd == -1)
+    {
+	fprintf(stderr, "Cannot open %s for reading.\n", filename);
+	return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < TB_HEADER)
+    {
+	fprintf(stderr, "%s is not a tablebase.\n", filename);
+	close(fd);
+	return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED)
+    {
+	fprintf(stderr, "Cannot map %s.\n", filename);
+	return false;
+    }
+    const unsigned char *h = p;
+    int volume = tb_get_u16(h+10);
+    size_t size = (size_t) st.st_size;
+    bool ok = (memcmp(h, TB_MAGIC, 4) == 0 && h[4] == TB_VERSION && volume <= BINS*S
+	       && size >= TB_HEADER + 8*(size_t) (volume+2));
+    if(ok && (h[5] != BINS || tb_get_u16(h+6) != R || tb_get_u16(h+8) != S))
+    {
+	fprintf(stderr, "The tablebase %s is for %d/%d on %d bins.\n", filename, tb_get_u16(h+6), tb_get_u16(h+8), h[5]);
+	munmap(p, size);
+	return false;
+    }
+    const unsigned char *records = h + TB_HEADER + 8*(volume+2);
+    for(int v = 0; ok && v <= volume; v++)
+    {
+	llu start = tb_get_u64(h + TB_HEADER + 8*v), end = tb_get_u64(h + TB_HEADER + 8*(v+1));
+	ok = (start <= end && (size_t) (records - h) + end * TB_RECORD <= size);
+	tb_records[v] = records + start * TB_RECORD;
+	tb_count[v] = end - start;
+    }
+    if(!ok)
+    {
+	fprintf(stderr, "%s is not a valid tablebase.\n", filename);
+	munmap(p, size);
+	return false;
+    }
+    tb_map = p;
+    tb_map_size = size;
+    tb_volume = volume;
+    fprintf(stderr, "Read a tablebase of volume %d from %s.\n", volume, filename);
+    return true;
+}
+
+void tablebase_free()
+{
+    if(tb_map != NULL)
+    {
+	munmap(tb_map, tb_map_size);
+	tb_map = NULL;
+    } else {
+	for(int v = 0; v <= tb_volume; v++)
+	{
+	    free((void *) tb_records[v]);
+	}
+    }
+    tb_volume = -1;
+}
+
+#endif
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <limits.h>
+
+#include "common.h"
+#include "hash.h"
+#include "alloc.h"
+#include "dynprog.h"
+#include "measure.h"
+#include "minimax.h"
+
+// Threshold search (--threshold): instead of one bit for the fixed R, every
+// configuration gets the smallest capacity at which the algorithm wins, i.e.
+// one more than the largest load the adversary can force. The game is
+// monotone in the capacity, so this is a max-min value, found by a fail-soft
+// alpha-beta search with integer windows; the bounds learned for each
+// configuration are cached. R in common.h is the largest capacity of
+// interest, so a single run finds the best lower bound R'/S for R' <= R.
+// The good situations and the k-moves hold for the fixed R only and are not
+// used; the dynamic programming does not depend on R and is shared.
+
+#ifndef _THRESHOLD_H
+#define _THRESHOLD_H 1
+
+// Bounds of the threshold of a configuration; key 0 is empty.
+struct th_entry {
+    llu key;
+    unsigned char low, high;
+};
+
+typedef struct th_entry th_entry;
+
+// The table of solver s is direct-mapped, a new entry always replaces the old one.
+void threshold_init(solver *s)
+{
+    s->thht = large_alloc(s->thsize * sizeof(th_entry));
+}
+
+void threshold_cleanup(solver *s)
+{
+    if(s->thht != NULL)
+    {
+	large_free(s->thht);
+	s->thht = NULL;
+    }
+}
+
+llu th_key(const binconf *b)
+{
+    llu key = b->loadhash ^ b->itemhash;
+    return (key == 0) ? 1 : key;
+}
+
+int th_max(int a, int b)
+{
+    return (a > b) ? a : b;
+}
+
+int th_min(int a, int b)
+{
+    return (a < b) ? a : b;
+}
+
+int th_adversary(solver *s, const binconf *b, int alpha, int beta);
+
+/* The threshold after the algorithm packs item k into b, the minimum over the
+ * bins; fail-soft as th_adversary(). Children whose new load alone reaches
+ * beta fail high without a search, so the loads searched stay below R.
+ */
+int th_algorithm(solver *s, const binconf *b, int k, int alpha, int beta)
+{
+    int best = INT_MAX;
+    for(int i=1; i<=BINS && best > alpha; i++)
+    {
+	if(i > 1 && b->loads[i] == b->loads[i-1])
+	    continue;
+	int v = th_max(b->loads[1], b->loads[i] + k) + 1;
+	if(v < th_min(beta, best))
+	{
+	    binconf d;
+	    duplicate(&d, b);
+	    d.loads[i] += k;
+	    d.items[k]++;
+	    sortloads(&d);
+	    rehash(&d, b, k);
+	    v = th_adversary(s, &d, alpha, th_min(beta, best));
+	}
+	best = th_min(best, v);
+    }
+    return best;
+}
+
+/* Returns the threshold of configuration b within the window (alpha, beta):
+ * the exact value if it lies inside, otherwise a value v <= alpha which the
+ * threshold does not exceed, or a value v >= beta which it reaches.
+ */
+int th_adversary(solver *s, const binconf *b, int alpha, int beta)
+{
+#ifdef MEASURE
+    s->measure.th_vertices++;
+#endif
+    // the largest load stays, and the algorithm can put the rest into the smallest bin
+    int low = b->loads[1] + 1;
+    int high = th_max(b->loads[1], b->loads[BINS] + (BINS*S - totalload(b))) + 1;
+
+    th_entry *e = &s->thht[th_key(b) & (s->thsize-1)];
+    if(e->key == th_key(b))
+    {
+	low = th_max(low, e->low);
+	high = th_min(high, e->high);
+    }
+    if(low >= high || low >= beta)
+	return low;
+    if(high <= alpha)
+	return high;
+
+    int res[BINS+ADV_HEURISTIC_K];
+    MAXIMUM_FEASIBLE(s, b, res);
+    int best = low;
+    for(int k = res[0]; k > 0 && best < beta && best < high; k--)
+    {
+	best = th_max(best, th_algorithm(s, b, k, th_max(alpha, best), beta));
+    }
+
+    if(best <= alpha)
+    {
+	high = th_min(high, best);
+    } else if(best >= beta)
+    {
+	low = th_max(low, best);
+    } else {
+	low = high = best;
+    }
+    e->key = th_key(b);
+    e->low = (unsigned char) low;
+    e->high = (unsigned char) th_min(high, 255);
+    return best;
+}
+
+/* Finds the threshold of configuration b up to R + 1. Returns the largest
+ * R' <= R for which the adversary wins, that is a lower bound of R'/S, or S
+ * if there is none; R itself if the adversary wins even there.
+ */
+int threshold_search(solver *s, const binconf *b)
+{
+    int t = th_adversary(s, b, S, R+1);
+    return th_min(t, R+1) - 1;
+}
+
+#endif
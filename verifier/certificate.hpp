@@ -0,0 +1,298 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "verifier.hpp"
+
+// Reading and writing of binary certificates; the format is described in data/README.
+
+#ifndef _CERTIFICATE_HPP
+#define _CERTIFICATE_HPP 1
+
+const char CERT_MAGIC[] = "BSLB";
+const int CERT_VERSION = 1;
+const llu NOT_WRITTEN = (llu) -1; // dense id of a vertex not written yet
+
+// Sequential reader of the certificate held in memory; ok is cleared on reading past the end.
+class CertReader {
+public:
+    const unsigned char *pos, *end;
+    bool ok;
+
+    CertReader(const vector<unsigned char> &buf) : pos(buf.data()), end(buf.data() + buf.size()), ok(true) {};
+
+    int byte() {
+	if (pos >= end) {
+	    ok = false;
+	    return 0;
+	}
+	return *pos++;
+    }
+
+    int u16() {
+	int low = byte();
+	return low | (byte() << 8);
+    }
+
+    llu varint() {
+	llu x = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+	    int b = byte();
+	    x |= (llu) (b & 0x7f) << shift;
+	    if ((b & 0x80) == 0) {
+		return x;
+	    }
+	}
+	ok = false;
+	return 0;
+    }
+};
+
+// Checks if the file starts with the certificate magic.
+bool is_certificate(const char *filename)
+{
+    char magic[4];
+    FILE *fin = fopen(filename, "rb");
+    if (fin == NULL) {
+	return false;
+    }
+    bool ret = (fread(magic, 1, 4, fin) == 4 && memcmp(magic, CERT_MAGIC, 4) == 0);
+    fclose(fin);
+    return ret;
+}
+
+// Reads the certificate file into memory.
+int read_certificate_file(const char *filename, vector<unsigned char> &buf)
+{
+    FILE *fin = fopen(filename, "rb");
+    if (fin == NULL) {
+	ERROR("Unable to open file %s\n", filename);
+    }
+    unsigned char chunk[1 << 16];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), fin)) > 0) {
+	buf.insert(buf.end(), chunk, chunk + len);
+    }
+    fclose(fin);
+    return 0;
+}
+
+// Reads the header up to the instance; returns -1 if it is not a supported certificate.
+int read_certificate_header(CertReader &in, const char *filename, int &bins, int &r, int &s)
+{
+    char magic[4];
+    for (int i = 0; i < 4; i++) {
+	magic[i] = (char) in.byte();
+    }
+    if (memcmp(magic, CERT_MAGIC, 4) != 0 || in.byte() != CERT_VERSION) {
+	ERROR("%s is not a certificate of a supported version.\n", filename);
+    }
+    bins = in.byte();
+    r = in.u16();
+    s = in.u16();
+    return 0;
+}
+
+// Reads the instance of a certificate from its header.
+int read_certificate_instance(const char *filename, int &bins, int &r, int &s)
+{
+    vector<unsigned char> buf;
+    if (read_certificate_file(filename, buf) != 0) {
+	return -1;
+    }
+    CertReader in(buf);
+    return read_certificate_header(in, filename, bins, r, s);
+}
+
+/* Reads a certificate into the tree of the verifier. Vertex ids are the dense ids
+ * of the file and the root is 0. Configurations are computed from the parent's
+ * configuration, the next item and the bin receiving it, so fill_types() is not needed;
+ * a vertex reached with two different configurations is an error.
+ */
+template <int BINS, int CAP> int read_certificate(Verifier<BINS, CAP> &ver, const char *filename)
+{
+    typedef Binconf<BINS, CAP> Conf;
+    typedef typename Verifier<BINS, CAP>::index_t index_t;
+    typedef typename Verifier<BINS, CAP>::LoadsArray LoadsArray;
+    vector<unsigned char> buf;
+    if (read_certificate_file(filename, buf) != 0) {
+	return -1;
+    }
+
+    CertReader in(buf);
+    int bins, r, s;
+    if (read_certificate_header(in, filename, bins, r, s) != 0) {
+	return -1;
+    }
+    if (bins != BINS || r != R || s != S) {
+	ERROR("The certificate is for %d/%d on %d bins, but the instance is %d/%d on %d bins.\n",
+	      r, s, bins, R, S, BINS);
+    }
+
+    llu n = in.varint();
+    if (!in.ok || n == 0 || n > buf.size()) {
+	ERROR("Invalid number of vertices in the certificate.\n");
+    }
+
+    LoadsArray root_loads;
+    for (int i = 0; i < BINS; i++) {
+	root_loads[i] = in.byte();
+    }
+    for (int j = 1; j <= S; j++) {
+	llu count = in.varint();
+	if (count > MAX_ITEM_COUNT) {
+	    ERROR("Too many items of size %d in the root of the certificate.\n", j);
+	}
+	ver.root_types[j] = (unsigned short) count;
+    }
+
+    LoadsArray empty;
+    empty.fill(0);
+    for (llu id = 0; id < n; id++) {
+	ver.add_vertex(id, id == 0 ? root_loads : empty, 0);
+    }
+    ver.root = 0;
+    ver.parent[0] = 0;
+
+    vector< pair<index_t, index_t> > edges;
+    for (index_t v = 0; v < n; v++) {
+	if (!in.ok) {
+	    ERROR("The certificate is truncated.\n");
+	}
+	if (ver.parent[v] == Verifier<BINS, CAP>::NONE) {
+	    ERROR("Vertex %u is not a child of an earlier vertex.\n", v);
+	}
+	int item = in.byte();
+	int count = in.byte();
+	if (item < 1 || item > S || count > BINS) {
+	    ERROR("Invalid vertex %u in the certificate.\n", v);
+	}
+	ver.next_item[v] = (unsigned char) item;
+	Conf b = ver.configuration(v);
+
+	for (int c = 0; c < count; c++) {
+	    int bin = in.byte();
+	    llu zigzag = in.varint();
+	    long long offset = (zigzag & 1) ? -(long long) ((zigzag + 1) >> 1) : (long long) (zigzag >> 1);
+	    llu child = v + offset;
+	    if (!in.ok || bin >= BINS || child >= n) {
+		ERROR("Invalid edge from vertex %u in the certificate.\n", v);
+	    }
+
+	    Conf next_step(b);
+	    next_step.pack(item, bin);
+	    if (ver.parent[child] == Verifier<BINS, CAP>::NONE) {
+		for (int i = 0; i < BINS; i++) {
+		    ver.loads[child][i] = (unsigned short) next_step.loads[i];
+		}
+		ver.parent[child] = v;
+	    } else if (!ver.same(ver.configuration(child), next_step)) {
+		ERROR("Vertex %llu is reached with two different configurations.\n", child);
+	    }
+	    edges.push_back(make_pair(v, (index_t) child));
+	}
+    }
+
+    if (!in.ok || in.pos != in.end) {
+	ERROR("The certificate is truncated or has trailing data.\n");
+    }
+    ver.set_children(edges);
+    return 0;
+}
+
+// A vertex of the certificate being written.
+struct CertRecord {
+    int item;
+    vector< pair<int, llu> > children; // bin and dense id
+};
+
+/* Assigns a dense id to the indexed vertex with the configuration b and to its
+ * descendants in preorder. Every admissible packing of the next item gets an edge,
+ * also if the child is only present elsewhere in the tree; configurations are
+ * written once, dense[] holds the dense id of each indexed vertex written so far.
+ */
+template <int BINS, int CAP> llu assign_dense_ids(const Verifier<BINS, CAP> &ver,
+    typename Verifier<BINS, CAP>::index_t v, const Binconf<BINS, CAP> &b,
+    vector<llu> &dense, vector<CertRecord> &records)
+{
+    llu dense_id = records.size();
+    dense[v] = dense_id;
+    records.push_back(CertRecord());
+    records[dense_id].item = ver.next_item[v];
+
+    for (int bin = 0; bin < BINS; bin++) {
+	if (bin > 0 && b.loads[bin] == b.loads[bin-1]) {
+	    continue;
+	}
+	Binconf<BINS, CAP> next_step(b);
+	if (!next_step.pack(ver.next_item[v], bin)) {
+	    continue;
+	}
+
+	auto found = ver.find(next_step);
+	if (found == Verifier<BINS, CAP>::NONE) {
+	    DEBUG_PRINT("The child of vertex %llu in bin %d is missing.\n", ver.ids[v], bin);
+	    continue;
+	}
+	llu child = dense[found];
+	if (child == NOT_WRITTEN) {
+	    child = assign_dense_ids(ver, found, next_step, dense, records);
+	}
+	records[dense_id].children.push_back(make_pair(bin, child));
+    }
+    return dense_id;
+}
+
+void put_varint(FILE *fout, llu x)
+{
+    while (x >= 0x80) {
+	fputc((int) (x & 0x7f) | 0x80, fout);
+	x >>= 7;
+    }
+    fputc((int) x, fout);
+}
+
+// Writes the tree with configurations already filled in as a certificate.
+template <int BINS, int CAP> int write_certificate(Verifier<BINS, CAP> &ver, const char *filename)
+{
+    vector<llu> dense(ver.size(), NOT_WRITTEN);
+    vector<CertRecord> records;
+    ver.build_index();
+    const Binconf<BINS, CAP> root = ver.configuration(ver.root);
+    assign_dense_ids(ver, ver.find(root), root, dense, records);
+
+    FILE *fout = fopen(filename, "wb");
+    if (fout == NULL) {
+	ERROR("Unable to open file %s\n", filename);
+    }
+    fwrite(CERT_MAGIC, 1, 4, fout);
+    fputc(CERT_VERSION, fout);
+    fputc(BINS, fout);
+    fputc(R & 0xff, fout);
+    fputc(R >> 8, fout);
+    fputc(S & 0xff, fout);
+    fputc(S >> 8, fout);
+    put_varint(fout, records.size());
+    for (int i = 0; i < BINS; i++) {
+	fputc(root.loads[i], fout);
+    }
+    for (int j = 1; j <= S; j++) {
+	put_varint(fout, root.types[j]);
+    }
+
+    for (llu id = 0; id < records.size(); id++) {
+	fputc(records[id].item, fout);
+	fputc((int) records[id].children.size(), fout);
+	for (auto const &edge : records[id].children) {
+	    long long offset = (long long) edge.second - (long long) id;
+	    fputc(edge.first, fout);
+	    put_varint(fout, (offset >= 0) ? (llu) offset << 1 : ((llu) (-offset) << 1) - 1);
+	}
+    }
+    if (fclose(fout) != 0) {
+	ERROR("Unable to write file %s\n", filename);
+    }
+    fprintf(stderr, "Wrote a certificate with %zu vertices to %s.\n", records.size(), filename);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <cstring>
+#include "verifier.hpp"
+#include "dot.hpp"
+#include "certificate.hpp"
+#include "instance.hpp"
+
+// Converts a lower bound between the DOT format and the binary certificate format.
+// The direction is given by the format of the input file.
+
+using namespace std;
+
+struct ConvertJob {
+    const char *input, *output;
+
+    template <int BINS, int CAP> int run() {
+	Verifier<BINS, CAP> ver;
+	typename Verifier<BINS, CAP>::index_t root;
+
+	if (is_certificate(input)) {
+	    if (read_certificate(ver, input) != 0) {
+		return -1;
+	    }
+	    return write_dot(ver, output);
+	}
+
+	if (read_dot(ver, input, root) != 0) {
+	    return -1;
+	}
+	if (ver.fill_types(root) != 0) {
+	    return -1;
+	}
+	return write_certificate(ver, output);
+    }
+};
+
+void usage()
+{
+    fprintf(stderr, "Usage: ./convert [--bins B] [--r R] [--s S] input.dot output.cert\n");
+    fprintf(stderr, "       ./convert [--bins B] [--r R] [--s S] input.cert output.dot\n");
+    fprintf(stderr, "The instance is read from the input; --bins, --r and --s override it.\n");
+}
+
+int main(int argc, char **argv)
+{
+    ConvertJob job;
+    job.input = job.output = NULL;
+    int bins = 0, r = 0, s = 0;
+
+    for (int i = 1; i < argc; i++) {
+	if (parse_instance_option(argc, argv, i, bins, r, s)) {
+	    continue;
+	} else if (job.input == NULL && argv[i][0] != '-') {
+	    job.input = argv[i];
+	} else if (job.output == NULL && argv[i][0] != '-') {
+	    job.output = argv[i];
+	} else {
+	    usage();
+	    return -3;
+	}
+    }
+    if (job.output == NULL) {
+	usage();
+	return -3;
+    }
+
+    if (read_instance(job.input, bins, r, s) != 0) {
+	return -1;
+    }
+    return dispatch(bins, job);
+}
@@ -0,0 +1,308 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "verifier.hpp"
+
+// Reading and writing of game trees in the DOT format produced by the lower bound generator.
+
+#ifndef _DOT_HPP
+#define _DOT_HPP 1
+
+// Hand-written scanner over a memory-mapped DOT file; counts lines for error messages.
+class DotScanner {
+public:
+    const char *pos, *end;
+    llu line;
+
+    DotScanner(const char *begin, size_t length) : pos(begin), end(begin + length), line(1) {};
+
+    void skip_space() {
+	while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')) {
+	    if (*pos == '\n') {
+		line++;
+	    }
+	    pos++;
+	}
+    }
+
+    bool at_end() {
+	skip_space();
+	return pos >= end;
+    }
+
+    // Consumes the literal if it comes next, after optional whitespace.
+    bool literal(const char *lit) {
+	skip_space();
+	size_t len = strlen(lit);
+	if ((size_t) (end - pos) >= len && memcmp(pos, lit, len) == 0) {
+	    pos += len;
+	    return true;
+	}
+	return false;
+    }
+
+    bool number(llu &x) {
+	skip_space();
+	if (pos >= end || *pos < '0' || *pos > '9') {
+	    return false;
+	}
+	x = 0;
+	while (pos < end && *pos >= '0' && *pos <= '9') {
+	    x = x*10 + (llu) (*pos - '0');
+	    pos++;
+	}
+	return true;
+    }
+
+    bool number(int &x) {
+	llu value;
+	if (!number(value) || value > 1000000) {
+	    return false;
+	}
+	x = (int) value;
+	return true;
+    }
+};
+
+/* Parses the DOT output of the lower bound generator into the tree of the verifier.
+ * DOT ids are mapped to dense vertex indices, and edges are kept aside until all
+ * vertices are known, as the children are usually defined after the edges to them.
+ */
+template <int BINS, int CAP> int parse_dot(Verifier<BINS, CAP> &ver, DotScanner &in, const char *filename,
+					     typename Verifier<BINS, CAP>::index_t &root)
+{
+    typedef typename Verifier<BINS, CAP>::index_t index_t;
+    llu main_id, secondary_id, graph_id;
+    bool root_found = false;
+    unordered_map<llu, index_t> index_of;
+    vector< pair<index_t, llu> > edges; // source index and target id
+    index_of.reserve((in.end - in.pos) / 64); // a vertex and its edge take about 64 bytes
+
+    if (!in.literal("strict") || !in.literal("digraph") || !in.number(graph_id) || !in.literal("{")) {
+	ERROR("%s:%llu: expected \"strict digraph RS {\".\n", filename, in.line);
+    }
+    if (in.literal("overlap")) {
+	if (!in.literal("=") || !in.literal("none") || !in.literal(";")) {
+	    ERROR("%s:%llu: expected \"overlap = none;\".\n", filename, in.line);
+	}
+    }
+
+    while (!in.literal("}")) {
+	if (!in.number(main_id)) {
+	    ERROR("%s:%llu: expected a vertex id or the final brace.\n", filename, in.line);
+	}
+
+	// vertex descriptor
+	if (in.literal("[")) {
+	    typename Binconf<BINS, CAP>::LoadsArray loads; // current configuration
+	    int next;
+	    int total = 0;
+	    if (!in.literal("label=\"")) {
+		ERROR("%s:%llu: expected a label of vertex %llu.\n", filename, in.line, main_id);
+	    }
+	    for (int i = 0; i < BINS; i++) {
+		if (!in.number(loads[i]) || !in.literal("\\n")) {
+		    ERROR("%s:%llu: expected load %d of vertex %llu.\n", filename, in.line, i+1, main_id);
+		}
+		total += loads[i];
+	    }
+	    if (!in.literal("n:") || !in.number(next) || !in.literal("\"") || !in.literal("]") || !in.literal(";")) {
+		ERROR("%s:%llu: expected the next item of vertex %llu.\n", filename, in.line, main_id);
+	    }
+	    if (next > MAX_S) {
+		ERROR("%s:%llu: the next item %d of vertex %llu is out of range.\n", filename, in.line, next, main_id);
+	    }
+	    // the first definition of a vertex counts
+	    if (index_of.find(main_id) != index_of.end()) {
+		continue;
+	    }
+
+	    DEBUG_PRINT("Creating vertex %llu with next item %d\n", main_id, next);
+	    index_t v = ver.add_vertex(main_id, loads, next);
+	    index_of[main_id] = v;
+
+	    // If configuration is (0,0,0,...,0), set it as root.
+	    if (total == 0 && !root_found) {
+		DEBUG_PRINT("Setting vertex %llu as root.\n", main_id);
+		root = v;
+		root_found = true;
+	    }
+	}
+
+	// edge descriptor
+	else if (in.literal("->")) {
+	    if (!in.number(secondary_id)) {
+		ERROR("%s:%llu: expected the target of an edge from vertex %llu.\n", filename, in.line, main_id);
+	    }
+	    in.literal(";");
+	    auto relevant = index_of.find(main_id);
+	    if (relevant == index_of.end()) {
+		ERROR("%s:%llu: the edge starts in vertex %llu, which is not defined yet.\n", filename, in.line, main_id);
+	    }
+	    edges.push_back(make_pair(relevant->second, secondary_id));
+	    DEBUG_PRINT("Adding edge from %llu to %llu\n", main_id, secondary_id);
+	}
+	// undefined descriptor
+	else {
+	    ERROR("%s:%llu: expected a label or an edge after vertex id %llu.\n", filename, in.line, main_id);
+	}
+    }
+
+    if (!in.at_end()) {
+	ERROR("%s:%llu: unexpected data after the final brace.\n", filename, in.line);
+    }
+    if (!root_found) {
+	ERROR("The tree has no root vertex with all bins empty.\n");
+    }
+
+    vector< pair<index_t, index_t> > resolved;
+    resolved.reserve(edges.size());
+    for (auto const &e : edges) {
+	auto target = index_of.find(e.second);
+	if (target == index_of.end()) {
+	    ERROR("The edge from vertex %llu leads to vertex %llu, which is not defined.\n", ver.ids[e.first], e.second);
+	}
+	resolved.push_back(make_pair(e.first, target->second));
+    }
+    ver.set_children(resolved);
+    return 0;
+}
+
+// A file mapped read-only into memory; unmapped when it goes out of scope.
+class MappedFile {
+public:
+    const char *data;
+    size_t size;
+
+    MappedFile() : data(NULL), size(0) {};
+    ~MappedFile() {
+	if (data != NULL) {
+	    munmap((void *) data, size);
+	}
+    }
+
+    int map(const char *filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+	    ERROR("Unable to open file %s\n", filename);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+	    close(fd);
+	    ERROR("Unable to read file %s\n", filename);
+	}
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+	    ERROR("Unable to map file %s\n", filename);
+	}
+	madvise(p, st.st_size, MADV_SEQUENTIAL);
+	data = (const char *) p;
+	size = st.st_size;
+	return 0;
+    }
+};
+
+/* Reads the instance from the beginning of a DOT file. The number of bins is the
+ * number of loads in the first label. The graph is named by R followed by S, which
+ * is ambiguous in general; the split with S < R < 2S is taken if it is the only one,
+ * otherwise r and s are left as they are.
+ */
+int read_dot_instance(const char *filename, int &bins, int &r, int &s)
+{
+    MappedFile file;
+    if (file.map(filename) != 0) {
+	return -1;
+    }
+    DotScanner in(file.data, file.size);
+    llu graph_id, id;
+    if (!in.literal("strict") || !in.literal("digraph") || !in.number(graph_id) || !in.literal("{")) {
+	ERROR("%s:%llu: expected \"strict digraph RS {\".\n", filename, in.line);
+    }
+    if (in.literal("overlap")) {
+	in.literal("=");
+	in.literal("none");
+	in.literal(";");
+    }
+    if (!in.number(id) || !in.literal("[") || !in.literal("label=\"")) {
+	ERROR("%s:%llu: expected the label of the first vertex.\n", filename, in.line);
+    }
+    int load;
+    bins = 0;
+    while (in.number(load) && in.literal("\\n")) {
+	bins++;
+    }
+
+    int candidates = 0, cand_r = 0, cand_s = 0;
+    for (llu power = 10; power <= graph_id; power *= 10) {
+	llu rr = graph_id / power, ss = graph_id % power;
+	// S has no leading zeros
+	if (ss >= power / 10 && ss < rr && rr < 2*ss) {
+	    candidates++;
+	    cand_r = (int) rr;
+	    cand_s = (int) ss;
+	}
+    }
+    if (candidates == 1) {
+	r = cand_r;
+	s = cand_s;
+    }
+    return 0;
+}
+
+// Reads the tree from a DOT file into the verifier; stores the index of the root.
+// The file is memory-mapped and scanned by hand, which is much faster than fscanf().
+template <int BINS, int CAP> int read_dot(Verifier<BINS, CAP> &ver, const char *filename,
+					    typename Verifier<BINS, CAP>::index_t &root)
+{
+    MappedFile file;
+    if (file.map(filename) != 0) {
+	return -1;
+    }
+    DotScanner in(file.data, file.size);
+    return parse_dot(ver, in, filename, root);
+}
+
+template <int BINS, int CAP> void write_dot_vertex(const Verifier<BINS, CAP> &ver, FILE *fout,
+						   typename Verifier<BINS, CAP>::index_t v, vector<bool> &printed)
+{
+    printed[v] = true;
+    fprintf(fout, "%llu [label=\"", ver.ids[v]);
+    for (int i = 0; i < BINS; i++) {
+	fprintf(fout, "%d\\n", (int) ver.loads[v][i]);
+    }
+    fprintf(fout, "n: %d\"];\n", (int) ver.next_item[v]);
+
+    for (auto c = ver.child_start[v]; c < ver.child_start[v+1]; c++) {
+	auto child = ver.child_list[c];
+	fprintf(fout, "%llu -> %llu\n", ver.ids[v], ver.ids[child]);
+	if (!printed[child]) {
+	    write_dot_vertex(ver, fout, child, printed);
+	}
+    }
+}
+
+// Writes the tree reachable from the root in the DOT format; shared vertices are printed once.
+template <int BINS, int CAP> int write_dot(const Verifier<BINS, CAP> &ver, const char *filename)
+{
+    FILE *fout = fopen(filename, "w");
+    if (fout == NULL) {
+	ERROR("Unable to open file %s\n", filename);
+    }
+    vector<bool> printed(ver.size(), false);
+    fprintf(fout, "strict digraph %d%d {\n", R, S);
+    fprintf(fout, "overlap = none;\n");
+    write_dot_vertex(ver, fout, ver.root, printed);
+    fprintf(fout, "}\n");
+    if (fclose(fout) != 0) {
+	ERROR("Unable to write file %s\n", filename);
+    }
+    return 0;
+}
+
+#endif
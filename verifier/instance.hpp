@@ -0,0 +1,58 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include "verifier.hpp"
+#include "dot.hpp"
+#include "certificate.hpp"
+
+// The instance (BINS, R and S) of a tree, from the file or from the command line.
+
+#ifndef _INSTANCE_HPP
+#define _INSTANCE_HPP 1
+
+/* Parses --bins B, --r R and --s S at position i of the command line;
+ * returns false if argv[i] is not one of them.
+ */
+bool parse_instance_option(int argc, char **argv, int &i, int &bins, int &r, int &s)
+{
+    if (i+1 >= argc) {
+	return false;
+    }
+    if (strcmp(argv[i], "--bins") == 0) {
+	bins = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--r") == 0) {
+	r = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--s") == 0) {
+	s = atoi(argv[++i]);
+    } else {
+	return false;
+    }
+    return true;
+}
+
+/* Sets R and S, and bins, from the header of the file; values given on the
+ * command line (nonzero bins, r and s) take precedence.
+ */
+int read_instance(const char *filename, int &bins, int r, int s)
+{
+    int file_bins = 0, file_r = 0, file_s = 0;
+    int ret;
+    if (is_certificate(filename)) {
+	ret = read_certificate_instance(filename, file_bins, file_r, file_s);
+    } else {
+	ret = read_dot_instance(filename, file_bins, file_r, file_s);
+    }
+    if (ret != 0) {
+	return -1;
+    }
+
+    bins = (bins != 0) ? bins : file_bins;
+    R = (r != 0) ? r : file_r;
+    S = (s != 0) ? s : file_s;
+    if (R == 0 || S == 0) {
+	ERROR("R and S cannot be determined from %s, give them with --r and --s.\n", filename);
+    }
+    return 0;
+}
+
+#endif
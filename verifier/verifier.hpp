@@ -1,41 +1,63 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <cstdint>
 #include <vector>
 #include <array>
 #include <functional>
 #include <algorithm>
-#include <map>
-#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#ifndef _VERIFIER_HPP
+#define _VERIFIER_HPP 1
 
 #define ERROR(...) fprintf(stderr, __VA_ARGS__); return -1;
 
 #ifdef DEBUG
 #define DEBUG_PRINT(...) fprintf(stderr, __VA_ARGS__);
-#define DEBUG_PRINT_VERTEX(x) x.print_info();
 #else
 #define DEBUG_PRINT(...)
-#define DEBUG_PRINT_VERTEX(x) 
 #endif
 
 using namespace std;
-const int BINS = 3;
-const int R = 45; // capacity of a stretched bin
-const int S = 33; // capacity of a unit bin
 
 typedef long long unsigned int llu;
 
-// data structures for the dynamic programming test
-typedef std::array<int, BINS> LoadsArray;
-typedef std::map< LoadsArray, bool> ConfigMap;
-typedef std::queue< LoadsArray > ConfigQueue;
+/* The instance is read from the tree (or given on the command line) at startup.
+ * The code below is specialized for the number of bins and for a capacity CAP
+ * of the array of item types, which is the smallest supported one above S; see
+ * dispatch() at the end of the file.
+ */
+int R = 0; // capacity of a stretched bin
+int S = 0; // capacity of a unit bin
+const int MIN_BINS = 2;
+const int MAX_BINS = 8;
+const int MAX_S = 255;
+const int MAX_ITEM_COUNT = 65535; // of a single size
+// above this number of load tuples, the test keeps the reached ones in a hash set
+// instead of a flat array (of 4 bytes per tuple and thread)
+const llu FLAT_TUPLE_LIMIT = 1ULL << 24;
+
+// FNV-1a over an array of small integers
+template <class T, size_t N> size_t fnv_hash(const array<T, N> &a, size_t h = 14695981039346656037ULL)
+{
+    for (T x : a) {
+	h = (h ^ (size_t) x) * 1099511628211ULL;
+    }
+    return h;
+}
 
 // helper function which prints a bin configuration
-void print_array(const LoadsArray &ar)
+template <class T, size_t N> void print_array(const array<T, N> &ar)
 {
     fprintf(stderr, "(");
     bool first = true;
-    for (int i= 0; i<BINS; i++)
+    for (size_t i= 0; i<N; i++)
     {
 	if(first)
 	{
@@ -43,59 +65,26 @@ void print_array(const LoadsArray &ar)
 	} else {
 	    fprintf(stderr, ",");
 	}
-	
-	fprintf(stderr, "%d", ar[i]);
+
+	fprintf(stderr, "%d", (int) ar[i]);
     }
     fprintf(stderr, ")");
 }
 
-// Sets the array limits to a lexicographically first tuple.
-void first_tuple(LoadsArray &limits)
-{
-    for(int bin = 0; bin < BINS; bin++)
-    {
-	limits[bin] = 0;
-    }
-}
+// statistics of the dynamic programming test
+atomic<llu> feasibility_calls(0), feasibility_runs(0), feasibility_nanoseconds(0);
 
-// Checks if the array limits is the tuple (S,S,...,S).
-bool is_last_tuple(const LoadsArray &limits)
-{
-    for(int bin = 0; bin < BINS; bin ++)
-    {
-	if (limits[bin] < S) {
-	    return false;
-	}
-    }
-    // It is (S,S,...,S):
-    return true;
-}
-
-// Generates lexicographically next tuple; wraps around (this is never used).
-void next_tuple(LoadsArray &limits)
-{
-    for( int bin = BINS-1; bin >=0; bin--)
-    {
-	if( limits[bin] < S)
-	{
-	    limits[bin]++;
-	    break;
-	} else {
-	    limits[bin] = 0;
-	}
-    }
-}
-
-class Binconf {
+template <int BINS, int CAP> class Binconf {
 public:
+    typedef array<int, BINS> LoadsArray;
+    // item counts are narrow, so that the padding up to CAP costs no memory
+    typedef array<unsigned short, CAP> TypesArray;
+
     LoadsArray loads; // bin 0, bin 1, bin 2, ...
-    array<int, S+1> types; // types start at 1, end at S
+    TypesArray types; // types start at 1, end at S; the rest stays zero
     Binconf() {
-	for (int i = 0; i < S+1; i++)
-	{
-	    types[i] = 0;
-	}
-    }; 
+	types.fill(0);
+    };
 
     // packs a new item, returns false if the packing creates a bin of size >= R
     bool pack(int item, int bin) {
@@ -105,198 +94,496 @@ public:
 	if(loads[bin] >= R) {
 	    admissible = false;
 	}
-	
+
 	types[item]++;
 	sort(loads.begin(), loads.end(), std::greater<int>());
 
 	return admissible;
     };
 
+    // binomial(n, k) for n <= S+BINS and k <= BINS
+    static llu binomial(int n, int k) {
+	static const vector<llu> table = [] {
+	    vector<llu> t((S+BINS+1)*(BINS+1), 0);
+	    for (int m = 0; m <= S+BINS; m++) {
+		t[m*(BINS+1)] = 1;
+		for (int j = 1; j <= BINS && j <= m; j++) {
+		    t[m*(BINS+1) + j] = t[(m-1)*(BINS+1) + j-1] + t[(m-1)*(BINS+1) + j];
+		}
+	    }
+	    return t;
+	}();
+	return table[n*(BINS+1) + k];
+    }
+
+    // number of sorted load tuples (each load from 0 to S)
+    static llu tuple_count() {
+	return binomial(S+BINS, BINS);
+    }
+
+    // Rank of a sorted load tuple among all of them, 0 to tuple_count()-1: adding i
+    // to the i-th smallest load makes the tuple strictly increasing, and such
+    // tuples are ranked by the combinatorial number system.
+    static llu tuple_index(const LoadsArray &tuple) {
+	llu index = 0;
+	for (int i = 0; i < BINS; i++) {
+	    index += binomial(tuple[BINS-1-i] + i, i+1);
+	}
+	return index;
+    }
+
     // Checks if the optimum can pack the list of items stored into binconf
     // into BINS bins of capacity S. Uses sparse dynamic programming, as described
-    // in the paper.
-    bool test() {
-        ConfigQueue cur;
-	ConfigQueue prev;
-	ConfigMap cur_membership;
-	LoadsArray config;
+    // in the paper: the tuples of loads (sorted) reachable after each item, largest
+    // items first. Tuples already reached by the current item are marked in a flat
+    // array, indexed by their rank, with the number of the item, so that it is never
+    // cleared; if there are too many tuples for the array, a hash set of the ranks
+    // reached by the current item is used.
+    bool test() const {
+	const bool flat = (tuple_count() <= FLAT_TUPLE_LIMIT);
+	thread_local vector<unsigned int> reached;
+	thread_local unordered_set<llu> reached_set;
+	thread_local unsigned int stamp = 0;
+	if (flat && reached.size() != tuple_count()) {
+	    reached.assign(tuple_count(), 0);
+	}
+	vector<LoadsArray> prev, cur;
 	LoadsArray newconf;
 	DEBUG_PRINT("Testing feasibility by an offline optimum.\n");
 
-	bool first_item = true;
-	
-	for(int type=1; type<=S; type++) {
-	    int amount = types[type];
-	    while(amount > 0) {
-		if (first_item)
-		{
-		    for (int bin = 0; bin < BINS; bin++)
-		    {
-			config[bin] = 0;
-		    }
-		    config[0] = type;
-		    cur.push(config);
-		    cur_membership[config] = true;
-		    first_item = false;
-		} else {
-		    while(!prev.empty())
-		    {
-			config = prev.front();
-			prev.pop();
-			// if the configuration is not yet in the current queue
-			if(cur_membership.find(config) == cur_membership.end())
-			{
-			    for (int bin = 0; bin < BINS; bin++)
-			    {
-				if(config[bin] + type <= S)
-				{
-				    newconf = config;
-				    newconf[bin] += type;
-				    sort(newconf.begin(), newconf.end(), std::greater<int>());
-				    if(cur_membership.find(newconf) == cur_membership.end())
-				    {
-					cur.push(newconf);
-					cur_membership[newconf] = true;
-				    }
-	       
-				}
+	LoadsArray empty;
+	empty.fill(0);
+	prev.push_back(empty);
+
+	for(int type=S; type>=1; type--) {
+	    for(int amount = 0; amount < types[type]; amount++) {
+		stamp++;
+		cur.clear();
+		reached_set.clear();
+		for (const LoadsArray &config : prev) {
+		    for (int bin = 0; bin < BINS; bin++) {
+			// bins of equal load give the same tuple
+			if (bin > 0 && config[bin] == config[bin-1]) {
+			    continue;
+			}
+			if (config[bin] + type <= S) {
+			    newconf = config;
+			    newconf[bin] += type;
+			    // restore the non-increasing order by moving the bin left
+			    for (int j = bin; j > 0 && newconf[j] > newconf[j-1]; j--) {
+				swap(newconf[j], newconf[j-1]);
+			    }
+			    llu index = tuple_index(newconf);
+			    bool fresh;
+			    if (flat) {
+				fresh = (reached[index] != stamp);
+				reached[index] = stamp;
+			    } else {
+				fresh = reached_set.insert(index).second;
+			    }
+			    if (fresh) {
+				cur.push_back(newconf);
 			    }
 			}
 		    }
 		}
+		if (cur.empty()) {
+		    return false;
+		}
 		swap(cur, prev);
-		cur_membership.clear();
-		amount--;
 	    }
 	}
+	return true;
+    }
+};
+
+/* The game tree of an instance with its indices, and the validation.
+ * Vertices have dense indices 0..size()-1 and are stored as a structure of arrays
+ * with narrow types. The item multiset of a vertex is not stored: it is the one of
+ * its parent (the vertex through which it was reached first) plus the parent's next
+ * item, up to the root, whose multiset is stored.
+ */
+template <int BINS, int CAP> class Verifier {
+public:
+    typedef Binconf<BINS, CAP> Conf;
+    typedef typename Conf::LoadsArray LoadsArray;
+    typedef typename Conf::TypesArray TypesArray;
+    typedef array<unsigned short, BINS> NarrowLoads;
+    typedef uint32_t index_t;
+    static const index_t NONE = UINT32_MAX;
+
+    vector<llu> ids; // ids in the input file, for messages and the DOT output
+    vector<NarrowLoads> loads;
+    vector<unsigned char> next_item;
+    vector<index_t> parent; // NONE if not reached from the root; the root is its own parent
+    vector<signed char> valid; // result of validation, -1 if not validated yet
+    // children of v are child_list[child_start[v]], ..., child_list[child_start[v+1]-1]
+    vector<index_t> child_start, child_list;
+    index_t root;
+    TypesArray root_types;
+
+    // open addressing index of the vertices by configuration; a slot keeps the upper
+    // half of the hash, so that most mismatches need no reconstruction of the configuration
+    struct IndexSlot {
+	index_t vertex;
+	uint32_t hash;
+    };
+    vector<IndexSlot> index_slots;
+
+    // results of the feasibility test for each item multiset, shared by all threads
+    struct TypesHash {
+	size_t operator()(const TypesArray &types) const {
+	    return fnv_hash(types);
+	}
+    };
+    unordered_map<TypesArray, bool, TypesHash> feasibility_memo;
+    mutex feasibility_mutex;
+
+    Verifier() : root(NONE) {
+	root_types.fill(0);
+	child_start.push_back(0);
+    };
+
+    index_t size() const {
+	return (index_t) ids.size();
+    }
+
+    // Adds a vertex; its children are given later by set_children().
+    index_t add_vertex(llu id, const LoadsArray &l, int next) {
+	NarrowLoads narrow;
+	for (int i = 0; i < BINS; i++) {
+	    // loads above 65535 stay invalid when clamped, as R is smaller
+	    narrow[i] = (unsigned short) min(l[i], 65535);
+	}
+	ids.push_back(id);
+	loads.push_back(narrow);
+	next_item.push_back((unsigned char) next);
+	parent.push_back(NONE);
+	valid.push_back(-1);
+	return size() - 1;
+    }
+
+    // Sets the children from a list of edges (parent, child), keeping their order.
+    void set_children(const vector< pair<index_t, index_t> > &edges) {
+	child_start.assign(size() + 1, 0);
+	for (auto const &e : edges) {
+	    child_start[e.first + 1]++;
+	}
+	for (index_t v = 0; v < size(); v++) {
+	    child_start[v+1] += child_start[v];
+	}
+	child_list.resize(edges.size());
+	vector<index_t> pos(child_start.begin(), child_start.end() - 1);
+	for (auto const &e : edges) {
+	    child_list[pos[e.first]++] = e.second;
+	}
+    }
+
+    // The item multiset of a reached vertex, from the chain of its parents.
+    TypesArray types_of(index_t v) const {
+	TypesArray types = root_types;
+	while (v != root) {
+	    v = parent[v];
+	    types[next_item[v]]++;
+	}
+	return types;
+    }
+
+    Conf configuration(index_t v) const {
+	Conf b;
+	for (int i = 0; i < BINS; i++) {
+	    b.loads[i] = loads[v][i];
+	}
+	b.types = types_of(v);
+	return b;
+    }
+
+    static size_t conf_hash(const Conf &b) {
+	return fnv_hash(b.types, fnv_hash(b.loads));
+    }
+
+    static bool same(const Conf &a, const Conf &b) {
+	return a.loads == b.loads && a.types == b.types;
+    }
 
-	// if no items arrived, it is trivially True
-	if(first_item == true) {
+    /* Reaches child from v: sets its parent, or if it is reached already, checks that
+     * its item multiset agrees. Returns false on a conflict.
+     */
+    bool reach(index_t v, index_t child) {
+	if (parent[child] == NONE) {
+	    parent[child] = v;
 	    return true;
 	}
-	// if queue is still nonempty, a packing is possible
-	else if(! prev.empty())
+	TypesArray types = types_of(v);
+	types[next_item[v]]++;
+	return types_of(child) == types;
+    }
+
+    /* Fills in the parents of all vertices reachable from the root; needs to be run
+     * after the graph is complete. Uses an explicit stack and visits shared children
+     * once. A vertex reached with two different item multisets is an error.
+     */
+    int fill_types(index_t root_vertex) {
+	vector<index_t> stack;
+	root = root_vertex;
+	parent[root] = root;
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+	    index_t v = stack.back();
+	    stack.pop_back();
+	    if (child_start[v] != child_start[v+1] && (next_item[v] <= 0 || next_item[v] > S)) {
+		ERROR("Vertex %llu has children but an invalid next item %d.\n", ids[v], next_item[v]);
+	    }
+	    for (index_t c = child_start[v]; c < child_start[v+1]; c++) {
+		index_t child = child_list[c];
+		bool first = (parent[child] == NONE);
+		if (!reach(v, child)) {
+		    ERROR("Vertex %llu is reached with two different item multisets.\n", ids[child]);
+		}
+		if (first) {
+		    DEBUG_PRINT("Filling next item %d into vertex %llu\n", next_item[v], ids[child]);
+		    stack.push_back(child);
+		}
+	    }
+	}
+	return 0;
+    }
+
+    // Builds the index; needs to be run after the configurations are complete.
+    // Only vertices reachable from the root are indexed, as only they are validated.
+    void build_index() {
+	size_t reached = 0, slots = 1;
+	for (index_t v = 0; v < size(); v++) {
+	    reached += (parent[v] != NONE);
+	}
+	while (slots < 2 * reached) {
+	    slots <<= 1;
+	}
+	index_slots.assign(slots, IndexSlot{NONE, 0});
+	for (index_t v = 0; v < size(); v++) {
+	    if (parent[v] == NONE) {
+		continue;
+	    }
+	    Conf b = configuration(v);
+	    size_t hash = conf_hash(b);
+	    if (find(b, hash) == NONE) {
+		size_t slot = hash & (slots - 1);
+		while (index_slots[slot].vertex != NONE) {
+		    slot = (slot + 1) & (slots - 1);
+		}
+		index_slots[slot] = IndexSlot{v, (uint32_t) (hash >> 32)};
+	    }
+	}
+    }
+
+    // The indexed vertex with the configuration b, or NONE.
+    index_t find(const Conf &b, size_t hash) const {
+	size_t mask = index_slots.size() - 1;
+	for (size_t slot = hash & mask; index_slots[slot].vertex != NONE; slot = (slot + 1) & mask) {
+	    index_t v = index_slots[slot].vertex;
+	    if (index_slots[slot].hash == (uint32_t) (hash >> 32) && same(configuration(v), b)) {
+		return v;
+	    }
+	}
+	return NONE;
+    }
+
+    index_t find(const Conf &b) const {
+	return find(b, conf_hash(b));
+    }
+
+    // The result of the test(), memoized by the item multiset: many vertices differ
+    // only in the placement of the same items.
+    bool feasible(const Conf &b) {
+	feasibility_calls++;
 	{
-	    return true;
-	} else {
-	    return false;
+	    lock_guard<mutex> lock(feasibility_mutex);
+	    auto it = feasibility_memo.find(b.types);
+	    if (it != feasibility_memo.end()) {
+		return it->second;
+	    }
 	}
+
+	auto start = chrono::steady_clock::now();
+	bool result = b.test();
+	feasibility_nanoseconds += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+	feasibility_runs++;
+
+	lock_guard<mutex> lock(feasibility_mutex);
+	feasibility_memo[b.types] = result;
+	return result;
     }
-    
-    bool validate() {
+
+    bool validate(const Conf &b) {
 	DEBUG_PRINT("Validating its bin configuration\n");
 
 	int sumloads = 0, sumtypes = 0;
-	for (auto i: loads) {
+	for (auto i: b.loads) {
 	    if(i > R || i < 0) return false;
 	    sumloads += i;
 	}
 
-	for (unsigned int i=1; i<types.size(); i++) {
-	    sumtypes += i * types[i];
+	for (int i=1; i<=S; i++) {
+	    sumtypes += i * b.types[i];
 	}
-	
+
 	if(sumloads != sumtypes) return false;
 
-	return test();
+	return feasible(b);
     };
-};
 
-// Vertex of the game tree.
-class Vertex {
+    /* validate a vertex of the tree */
+    bool validate(index_t v) {
+	DEBUG_PRINT("Validating vertex %llu\n", ids[v]);
+	Conf b = configuration(v);
+	if(validate(b) == false) return false;
+	if(next_item[v] <= 0 || next_item[v] > S) return false;
 
-public:
-    /* We do not store pointers to children directly
-     * because children are not known at the time of the parent's creation,
-     * only their IDs. We store only IDs, at the cost of O(log n) access time.
-     */
-    vector<llu> children; 
-    Binconf* configuration;
-    int nextItem;
-    llu id;
-    
-    Vertex(Binconf* c_) : configuration(c_) {};
-    void fill_types();
-    bool validate();
-    bool recursive_validate();
-    void print_info();
-};
+	/* check that all possible packings of nextItem into configuration are present in the tree */
+	for(int i = 0; i<BINS; i++)
+	{
+	    Conf next_step(b);
+	    bool admissible = next_step.pack(next_item[v],i);
+	    if(!admissible) // skip this packing if it produces a load of size >= R
+		continue;
 
-// the map of all vertices in the game tree, indexed by ids,
-// which are produced by the lower bound generator
-map<llu, Vertex> tree;
+	    /* If there is a vertex in the tree with the same bin configuration */
+	    if (find(next_step) == NONE) {
+		DEBUG_PRINT("One of the valid children of vertex %llu was not found, namely: \n", ids[v]);
+		print_array(next_step.loads);
+		return false;
+	    }
+	}
+	return true;
+    };
 
+    // Collects the vertices reachable from the root, each of them once.
+    vector<index_t> reachable_vertices() const {
+	vector<index_t> order;
+	vector<bool> seen(size(), false);
+	order.push_back(root);
+	seen[root] = true;
+	for (size_t pos = 0; pos < order.size(); pos++) {
+	    index_t v = order[pos];
+	    for (index_t c = child_start[v]; c < child_start[v+1]; c++) {
+		if (!seen[child_list[c]]) {
+		    seen[child_list[c]] = true;
+		    order.push_back(child_list[c]);
+		}
+	    }
+	}
+	return order;
+    }
 
-void Vertex::print_info()
-{
-    print_array(configuration->loads);
-}
+    // number of vertices a thread takes at once
+    static const size_t VALIDATE_CHUNK = 64;
 
-// recursively fills in the loads array; needs to be run
-//   after the graph is complete
-
-void Vertex::fill_types() {
-    for(llu child_id: children) {
-	Vertex& child = tree.at(child_id);
-	std::copy(configuration->types.begin(), configuration->types.end(), child.configuration->types.begin());
-	assert(nextItem <= S);
-	DEBUG_PRINT("Filling next item %d into vertex %llu\n", nextItem, child_id);
-	(child.configuration->types[nextItem])++;
-	child.fill_types();
-    }
-}
+    /* Validates each vertex reachable from the root exactly once, on the given number
+     * of threads; results are kept in valid[]. Vertices are independent once their
+     * configurations are complete, so the threads take chunks of them from a shared
+     * counter and stop at the first failure, whose vertex is stored in failed_vertex.
+     */
+    bool validate_tree(int threads, index_t &failed_vertex) {
+	vector<index_t> order = reachable_vertices();
+	atomic<size_t> next(0);
+	atomic<bool> failed(false);
+	atomic<index_t> first_failure(NONE);
 
-    /* validate a vertex of the tree */
-bool Vertex::validate() {
-    DEBUG_PRINT("Validating vertex %llu\n", id);
-    if(configuration == NULL) return false;
-    if(configuration->validate() == false) return false;
-	if(nextItem <= 0 || nextItem > S) return false;
-	
-	/* check that all three possible packings of nextItem into configuration are valid */
-	bool found_all = true;
-	for(int i = 0; i<BINS; i++)
-	{
-	    Binconf next_step(*configuration);
-	    bool admissible = next_step.pack(nextItem,i);
-	    if(!admissible) // skip this packing if it produces a load of size >= R
-		continue;
-	    
-	    bool found = false;
-	    for (llu child_id: children)
-	    {
-		const Vertex& child = tree.at(child_id); 
-
-		/* If there is a vertex in the tree with the same bin configuration */
-		for (auto const &keypair : tree)
-		{
-		    if (equal(next_step.types.begin(), next_step.types.end(), (keypair.second).configuration->types.begin())
-			&& equal(next_step.loads.begin(), next_step.loads.end(), (keypair.second).configuration->loads.begin()))
-		    {
-			found = true;
-			break;
-		    }
-		    
+	auto worker = [&]() {
+	    while (!failed.load(memory_order_relaxed)) {
+		size_t start = next.fetch_add(VALIDATE_CHUNK);
+		if (start >= order.size()) {
+		    return;
 		}
-		if (!found) {
-		    DEBUG_PRINT("One of the valid children of vertex %llu was not found, namely: \n", id);
-		    print_array(next_step.loads);
-		    
-		    found_all = false;
-		    break;
+		size_t end = min(start + VALIDATE_CHUNK, order.size());
+		for (size_t pos = start; pos < end; pos++) {
+		    index_t v = order[pos];
+		    if (valid[v] == -1) {
+			valid[v] = validate(v);
+		    }
+		    if (!valid[v]) {
+			bool expected = false;
+			if (failed.compare_exchange_strong(expected, true)) {
+			    first_failure = v;
+			}
+			return;
+		    }
 		}
 	    }
+	};
+
+	vector<thread> pool;
+	for (int i = 1; i < threads; i++) {
+	    pool.push_back(thread(worker));
+	}
+	worker();
+	for (thread &t : pool) {
+	    t.join();
 	}
-	return found_all;
+
+	failed_vertex = first_failure;
+	return !failed;
+    }
+
+    // Reports the memory taken by the tree and its index.
+    void memory_report() const {
+	size_t bytes = ids.capacity()*sizeof(llu) + loads.capacity()*sizeof(NarrowLoads)
+	    + next_item.capacity() + parent.capacity()*sizeof(index_t) + valid.capacity()
+	    + (child_start.capacity() + child_list.capacity())*sizeof(index_t)
+	    + index_slots.capacity()*sizeof(IndexSlot);
+	fprintf(stderr, "Tree: %u vertices, %zu edges, %.1f MB (%.1f bytes per vertex).\n", size(), child_list.size(),
+		(double) bytes / (1 << 20), size() ? (double) bytes / size() : 0.0);
+    }
 };
 
-bool Vertex::recursive_validate() {
-    if (!validate()) return false;
-    for(llu child_id: children)
-    {
-	Vertex& child = tree.at(child_id);
-	    if(!child.recursive_validate()) return false;
+template <int BINS, int CAP> const typename Verifier<BINS, CAP>::index_t Verifier<BINS, CAP>::NONE;
+
+// binomial(s + bins, bins), the number of sorted load tuples of the feasibility test
+constexpr llu tuple_space(int bins, int s)
+{
+    llu count = 1;
+    for (int i = 1; i <= bins; i++) {
+	count = count * (s + i) / i;
+    }
+    return count;
+}
+
+// the ranks of the tuples have to fit into 64 bits for all supported instances
+static_assert(tuple_space(MAX_BINS, MAX_S) < (1ULL << 63), "MAX_BINS and MAX_S are too large for the feasibility test");
+
+template <int BINS, class Job> int dispatch_capacity(Job &job)
+{
+    if (S < 16) return job.template run<BINS, 16>();
+    if (S < 32) return job.template run<BINS, 32>();
+    if (S < 64) return job.template run<BINS, 64>();
+    if (S < 128) return job.template run<BINS, 128>();
+    return job.template run<BINS, MAX_S+1>();
+}
+
+/* Calls job.run<BINS, CAP>() with the code specialized for the instance;
+ * R and S need to be set first.
+ */
+template <class Job> int dispatch(int bins, Job &job)
+{
+    if (S < 1 || S > MAX_S || R <= S) {
+	ERROR("Unsupported instance %d/%d: S has to be between 1 and %d and R larger than S.\n", R, S, MAX_S);
+    }
+    if (bins >= MIN_BINS && bins <= MAX_BINS && tuple_space(bins, S) > FLAT_TUPLE_LIMIT) {
+	fprintf(stderr, "Note: %llu load tuples for %d bins and S = %d; the feasibility test uses a hash set.\n",
+		tuple_space(bins, S), bins, S);
+    }
+    switch (bins) {
+    case 2: return dispatch_capacity<2>(job);
+    case 3: return dispatch_capacity<3>(job);
+    case 4: return dispatch_capacity<4>(job);
+    case 5: return dispatch_capacity<5>(job);
+    case 6: return dispatch_capacity<6>(job);
+    case 7: return dispatch_capacity<7>(job);
+    case 8: return dispatch_capacity<8>(job);
+    default:
+	ERROR("Unsupported number of bins %d, the verifier supports %d to %d bins.\n", bins, MIN_BINS, MAX_BINS);
     }
-    return true;
 }
 
+#endif